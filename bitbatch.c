@@ -0,0 +1,144 @@
+//Timothy Colaneri
+//Universal Machine batched bit field implementation
+
+/* Every path computes the same thing for each word w: the opcode
+w >> 28; a mask that is all ones if that is a load value; and from
+it a, b, c and the immediate, each one shift and one 'and' away from
+w. The vector paths then narrow the opcode and registers from 32 bit
+lanes to bytes with saturating packs, which cannot saturate, as none
+is above 15.
+
+SSE2 is part of every x86-64, so the compiler always targets it
+there. AVX2 is not, so its path is built for it alone and chosen
+when the host turns out to have it.*/
+
+/**********************************************************************/
+#include"bitbatch.h" //Own header
+#if defined(__SSE2__)
+#include<immintrin.h>
+#define AVX2 __attribute__((target("avx2")))
+#endif
+
+#define LOADVAL 13
+#define REGMASK 7
+#define VALMASK 0x1ffffff
+/**********************************************************************/
+//Function unpack_one unpacks word 'i' of 'words' into 'fields'
+static inline void unpack_one(const uint32_t *words, size_t i, Bitbatch_fields fields){
+    uint32_t w = words[i];
+    fields.opcode[i] = w >> 28;
+    if (fields.opcode[i] == LOADVAL){
+        fields.a[i] = (w >> 25) & REGMASK;
+        fields.b[i] = 0;
+        fields.c[i] = 0;
+        fields.value[i] = w & VALMASK;
+    }
+    else{
+        fields.a[i] = (w >> 6) & REGMASK;
+        fields.b[i] = (w >> 3) & REGMASK;
+        fields.c[i] = w & REGMASK;
+        fields.value[i] = 0;
+    }
+}
+/**********************************************************************/
+#if defined(__SSE2__)
+//These unpack the eight words of 'w' into eight lanes of each field,
+//and narrow four vectors of lanes to 32 bytes in order. The packs
+//work within each 128 bit half, so the last step puts the groups of
+//four bytes back in order.
+typedef struct Lanes8 {
+    __m256i opcode, a, b, c;
+} Lanes8;
+static inline AVX2 Lanes8 unpack8(__m256i w, uint32_t *value){
+    const __m256i regs = _mm256_set1_epi32(REGMASK);
+    Lanes8 l;
+    l.opcode = _mm256_srli_epi32(w, 28);
+    __m256i lv = _mm256_cmpeq_epi32(l.opcode, _mm256_set1_epi32(LOADVAL));
+    __m256i a = _mm256_and_si256(_mm256_srli_epi32(w, 6), regs);
+    __m256i alv = _mm256_and_si256(_mm256_srli_epi32(w, 25), regs);
+    l.a = _mm256_blendv_epi8(a, alv, lv);
+    l.b = _mm256_andnot_si256(lv, _mm256_and_si256(_mm256_srli_epi32(w, 3), regs));
+    l.c = _mm256_andnot_si256(lv, _mm256_and_si256(w, regs));
+    _mm256_storeu_si256((__m256i *)value,
+                        _mm256_and_si256(lv, _mm256_and_si256(w, _mm256_set1_epi32(VALMASK))));
+    return l;
+}
+static inline AVX2 void narrow8(uint8_t *out, __m256i x0, __m256i x1, __m256i x2, __m256i x3){
+    __m256i bytes = _mm256_packus_epi16(_mm256_packs_epi32(x0, x1),
+                                        _mm256_packs_epi32(x2, x3));
+    bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    _mm256_storeu_si256((__m256i *)out, bytes);
+}
+//Function batch_avx2 unpacks 32 words a step and returns how many
+//it unpacked
+static AVX2 size_t batch_avx2(const uint32_t *words, size_t n, Bitbatch_fields fields){
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32){
+        Lanes8 l[4];
+        for (int k = 0; k < 4; ++k){
+            __m256i w = _mm256_loadu_si256((const __m256i *)(words + i + 8 * k));
+            l[k] = unpack8(w, fields.value + i + 8 * k);
+        }
+        narrow8(fields.opcode + i, l[0].opcode, l[1].opcode, l[2].opcode, l[3].opcode);
+        narrow8(fields.a + i, l[0].a, l[1].a, l[2].a, l[3].a);
+        narrow8(fields.b + i, l[0].b, l[1].b, l[2].b, l[3].b);
+        narrow8(fields.c + i, l[0].c, l[1].c, l[2].c, l[3].c);
+    }
+    return i;
+}
+/**********************************************************************/
+//These do the same for four words in 128 bit vectors, whose packs
+//keep the bytes in order
+typedef struct Lanes4 {
+    __m128i opcode, a, b, c;
+} Lanes4;
+static inline Lanes4 unpack4(__m128i w, uint32_t *value){
+    const __m128i regs = _mm_set1_epi32(REGMASK);
+    Lanes4 l;
+    l.opcode = _mm_srli_epi32(w, 28);
+    __m128i lv = _mm_cmpeq_epi32(l.opcode, _mm_set1_epi32(LOADVAL));
+    __m128i a = _mm_and_si128(_mm_srli_epi32(w, 6), regs);
+    __m128i alv = _mm_and_si128(_mm_srli_epi32(w, 25), regs);
+    l.a = _mm_or_si128(_mm_andnot_si128(lv, a), _mm_and_si128(lv, alv));
+    l.b = _mm_andnot_si128(lv, _mm_and_si128(_mm_srli_epi32(w, 3), regs));
+    l.c = _mm_andnot_si128(lv, _mm_and_si128(w, regs));
+    _mm_storeu_si128((__m128i *)value,
+                     _mm_and_si128(lv, _mm_and_si128(w, _mm_set1_epi32(VALMASK))));
+    return l;
+}
+static inline void narrow4(uint8_t *out, __m128i x0, __m128i x1, __m128i x2, __m128i x3){
+    _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(_mm_packs_epi32(x0, x1),
+                                                      _mm_packs_epi32(x2, x3)));
+}
+//Function batch_sse2 unpacks 16 words a step and returns how many
+//it unpacked
+static size_t batch_sse2(const uint32_t *words, size_t n, Bitbatch_fields fields){
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16){
+        Lanes4 l[4];
+        for (int k = 0; k < 4; ++k){
+            __m128i w = _mm_loadu_si128((const __m128i *)(words + i + 4 * k));
+            l[k] = unpack4(w, fields.value + i + 4 * k);
+        }
+        narrow4(fields.opcode + i, l[0].opcode, l[1].opcode, l[2].opcode, l[3].opcode);
+        narrow4(fields.a + i, l[0].a, l[1].a, l[2].a, l[3].a);
+        narrow4(fields.b + i, l[0].b, l[1].b, l[2].b, l[3].b);
+        narrow4(fields.c + i, l[0].c, l[1].c, l[2].c, l[3].c);
+    }
+    return i;
+}
+#endif
+/**********************************************************************/
+extern void Bitbatch_um(const uint32_t *words, size_t n, Bitbatch_fields fields){
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    i = __builtin_cpu_supports("avx2") ? batch_avx2(words, n, fields)
+                                       : batch_sse2(words, n, fields);
+#endif
+
+    for (; i < n; ++i){
+        unpack_one(words, i, fields);
+    }
+}
+/**********************************************************************/
@@ -0,0 +1,30 @@
+//Timothy Colaneri
+//Universal Machine batched bit field interface
+
+/**********************************************************************/
+#ifndef BITBATCH_INCLUDED
+#define BITBATCH_INCLUDED
+#include <inttypes.h>
+#include <stddef.h>
+/**********************************************************************/
+//Where Bitpack_getu takes one field out of one word, checking its width
+//every time, this module takes every field out of a whole array of UM
+//instruction words at once. struct Bitbatch_fields names the arrays the
+//fields go to, one element per word: the opcode from bits 28 to 31, the
+//registers a, b and c, and the 25 bit immediate of a load value. A load
+//value keeps its register, from bits 25 to 27, in 'a' and leaves b and
+//c 0; every other instruction takes a, b and c from bits 6, 3 and 0 and
+//leaves the immediate 0, as Decode_word does.
+typedef struct Bitbatch_fields {
+    uint8_t *opcode;
+    uint8_t *a, *b, *c;
+    uint32_t *value;
+} Bitbatch_fields;
+/**********************************************************************/
+extern void Bitbatch_um(const uint32_t *words, size_t n, Bitbatch_fields fields);
+//Bitbatch_um unpacks the 'n' words at 'words' into the arrays of
+//'fields', each of which needs room for 'n' elements. On x86 it runs
+//32 words a step if the host has AVX2 and 16 with SSE2 if not, and
+//elsewhere one at a time.
+/**********************************************************************/
+#endif
@@ -4,35 +4,406 @@
 /**********************************************************/
 #include<stdio.h>
 #include<stdlib.h>
+#include<string.h>
+#include<ctype.h>
+#include<errno.h>
 #include"um_load.h"
 #include"um_exec.h"
+#include"um_sample.h"
+#include"um_snapshot.h"
+#include"um_footprint.h"
+#include"um_cache.h"
 /**********************************************************/
 
 /**********************************************************/
 //This main function is the driver for the universal
-//machine
+//machine. The program is named by its file, or by "-"
+//for stdin, unless the machine is restored from a
+//snapshot. Options come before the program:
+//  --engine=switch|threaded|jit|checked
+//                            interpreter, threaded by default;
+//                            checked reports each fault the UM
+//                            specification allows with the PC
+//                            and the registers
+//  --output=stdout|discard|checksum
+//                            where output goes; checksum only
+//                            reports a checksum on stderr
+//  --output-file=PATH        write output to PATH instead
+//  --flush=BYTES             output buffered before a write
+//  --async-output[=BYTES]    write output from a thread of its
+//                            own, through a ring of BYTES
+//                            (1 MB by default)
+//  --alloc=malloc|slab|arena segment allocator, slab by default
+//  --cache=DIR               load the program predecoded from
+//                            the image cache in DIR, adding it
+//                            there on the first load
+//  --cache-size=BYTES        bytes of entries the cache keeps,
+//                            256 MB by default
+//  --stats                   report memory and dispatch counters
+//                            on stderr
+//  --footprint=FILE          sample the memory footprint of the
+//                            segments as a time series, written
+//                            to FILE as CSV at the end and on
+//                            SIGUSR1. Under the threaded engine
+//                            it is watched for after every load
+//                            program; under the others, only at
+//                            maps, unmaps and far jumps
+//  --footprint-interval=MS   milliseconds between samples, 100
+//                            by default
+//  --profile                 report executions by opcode and by
+//                            PC, load programs and the hottest
+//                            code on stderr; not with --engine
+//                            or another report
+//  --sample=FILE             sample the threaded engine at its
+//                            load programs and write collapsed
+//                            stacks for flame graphs to FILE;
+//                            not with another engine or report
+//  --sample-rate=HZ          samples per second of CPU time
+//  --fusion-profile          report the opcode sequences worth
+//                            fusing on stderr, from a run under
+//                            the switch interpreter; not with
+//                            --engine or another report
+//  --trace=FILE              record every instruction and memory
+//                            event under the switch interpreter,
+//                            writing the latest of them to FILE
+//                            at the end and on SIGQUIT; umtrace
+//                            decodes it. A traced run takes about
+//                            twice as long as one under the
+//                            threaded engine
+//  --trace-size=BYTES        memory the latest records are kept
+//                            in, 64 MB by default
+//  --record=FILE            log every input byte, with the
+//                            instructions run before it, to
+//                            FILE, under the switch interpreter
+//  --replay=FILE             take the input from a log written
+//                            by --record, held in memory, in
+//                            place of stdin
+//  --replay-check            replay under the switch interpreter,
+//                            stopping with an error at the first
+//                            input asked for at another count of
+//                            instructions than it was recorded at
+//  --snapshot=FILE           write the machine to FILE when
+//                            the --snapshot-at trigger fires,
+//                            then carry on
+//  --snapshot-at=N|input|signal
+//                            snapshot after N instructions,
+//                            before the first input, or on
+//                            SIGUSR2, the default
+//  --snapshot-stop           stop once the snapshot is written
+//  --restore=FILE            resume the machine in snapshot FILE
+//                            in place of loading a program
+//A snapshot on the signal under the threaded engine, the default,
+//is taken at the next load program, with the engine running as
+//usual until then. For the other triggers and engines, and along
+//with --trace or the input log, the machine runs under the switch
+//interpreter until the snapshot is taken, checking the trigger
+//between instructions.
 int main(int argc, char * argv[]){
 
-    //Check number of arguments
-    if (argc != 2){
+    Interp_status (*interp)(Memseg_T, unsigned *, uint32_t *, Umio_T) = Interp_prog_threaded;
+    int engine = 0;         //whether --engine chose interp
+    int profile = 0, fusionProfile = 0;
+    Umio_sink sink = UMIO_STDOUT;
+    const char *outPath = NULL;
+    size_t threshold = UMIO_THRESHOLD;
+    size_t ring = 0;        //bytes in the output ring, 0 for none
+    Memseg_alloc alloc = MEMSEG_SLAB;
+    const char *cacheDir = NULL;
+    uint64_t cacheSize = CACHE_LIMIT;
+    int stats = 0;
+    const char *samplePath = NULL;
+    unsigned sampleRate = SAMPLE_HZ;
+    const char *tracePath = NULL;
+    size_t traceSize = TRACE_SIZE;
+    const char *footprintPath = NULL;
+    unsigned footprintInterval = FOOTPRINT_INTERVAL;
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+    int replayCheck = 0;
+    const char *snapshotPath = NULL;
+    const char *restorePath = NULL;
+    uint64_t snapshotAt = UINT64_MAX;
+    int snapshotAtInput = 0;
+    int snapshotStop = 0;
+    int argi = 1;
+
+    //Read the options that come before the program name
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi){
+        if (strcmp(argv[argi], "--engine=switch") == 0){
+            interp = Interp_prog;
+            engine = 1;
+        }
+        else if (strcmp(argv[argi], "--engine=threaded") == 0){
+            interp = Interp_prog_threaded;
+            engine = 1;
+        }
+        else if (strcmp(argv[argi], "--engine=jit") == 0){
+            interp = Interp_prog_jit;
+            engine = 1;
+        }
+        else if (strcmp(argv[argi], "--engine=checked") == 0){
+            interp = Interp_prog_checked;
+            engine = 1;
+        }
+        else if (strcmp(argv[argi], "--output=stdout") == 0){
+            sink = UMIO_STDOUT;
+        }
+        else if (strcmp(argv[argi], "--output=discard") == 0){
+            sink = UMIO_DISCARD;
+        }
+        else if (strcmp(argv[argi], "--output=checksum") == 0){
+            sink = UMIO_CHECKSUM;
+        }
+        else if (strncmp(argv[argi], "--output-file=", 14) == 0){
+            sink = UMIO_FILE;
+            outPath = argv[argi] + 14;
+        }
+        else if (strncmp(argv[argi], "--flush=", 8) == 0){
+            threshold = strtoul(argv[argi] + 8, NULL, 10);
+        }
+        else if (strcmp(argv[argi], "--alloc=malloc") == 0){
+            alloc = MEMSEG_MALLOC;
+        }
+        else if (strcmp(argv[argi], "--alloc=slab") == 0){
+            alloc = MEMSEG_SLAB;
+        }
+        else if (strcmp(argv[argi], "--alloc=arena") == 0){
+            alloc = MEMSEG_ARENA;
+        }
+        else if (strncmp(argv[argi], "--cache=", 8) == 0){
+            cacheDir = argv[argi] + 8;
+        }
+        else if (strncmp(argv[argi], "--cache-size=", 13) == 0){
+            char *end;
+            errno = 0;
+            cacheSize = strtoull(argv[argi] + 13, &end, 10);
+            if (!isdigit((unsigned char)argv[argi][13]) || *end != '\0' || errno != 0){
+                fprintf(stderr,"Error, incorrect cache size %s.\n", argv[argi] + 13);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[argi], "--stats") == 0){
+            stats = 1;
+        }
+        else if (strncmp(argv[argi], "--footprint=", 12) == 0){
+            footprintPath = argv[argi] + 12;
+        }
+        else if (strncmp(argv[argi], "--footprint-interval=", 21) == 0){
+            footprintInterval = strtoul(argv[argi] + 21, NULL, 10);
+        }
+        else if (strcmp(argv[argi], "--async-output") == 0){
+            ring = UMIO_RING;
+        }
+        else if (strncmp(argv[argi], "--async-output=", 15) == 0){
+            ring = strtoul(argv[argi] + 15, NULL, 10);
+        }
+        else if (strcmp(argv[argi], "--profile") == 0){
+            profile = 1;
+        }
+        else if (strncmp(argv[argi], "--sample=", 9) == 0){
+            samplePath = argv[argi] + 9;
+        }
+        else if (strncmp(argv[argi], "--sample-rate=", 14) == 0){
+            sampleRate = strtoul(argv[argi] + 14, NULL, 10);
+        }
+        else if (strcmp(argv[argi], "--fusion-profile") == 0){
+            fusionProfile = 1;
+        }
+        else if (strncmp(argv[argi], "--trace=", 8) == 0){
+            tracePath = argv[argi] + 8;
+        }
+        else if (strncmp(argv[argi], "--trace-size=", 13) == 0){
+            traceSize = strtoull(argv[argi] + 13, NULL, 10);
+        }
+        else if (strncmp(argv[argi], "--record=", 9) == 0){
+            recordPath = argv[argi] + 9;
+        }
+        else if (strncmp(argv[argi], "--replay=", 9) == 0){
+            replayPath = argv[argi] + 9;
+        }
+        else if (strcmp(argv[argi], "--replay-check") == 0){
+            replayCheck = 1;
+        }
+        else if (strncmp(argv[argi], "--snapshot=", 11) == 0){
+            snapshotPath = argv[argi] + 11;
+        }
+        else if (strcmp(argv[argi], "--snapshot-at=input") == 0){
+            snapshotAtInput = 1;
+        }
+        else if (strcmp(argv[argi], "--snapshot-at=signal") == 0){
+            snapshotAt = UINT64_MAX;
+        }
+        else if (strncmp(argv[argi], "--snapshot-at=", 14) == 0){
+            snapshotAt = strtoull(argv[argi] + 14, NULL, 10);
+        }
+        else if (strcmp(argv[argi], "--snapshot-stop") == 0){
+            snapshotStop = 1;
+        }
+        else if (strncmp(argv[argi], "--restore=", 10) == 0){
+            restorePath = argv[argi] + 10;
+        }
+        else{
+            fprintf(stderr,"Error, unknown option %s.\n", argv[argi]);
+            exit(1);
+        }
+    }
+
+    //A report runs under an engine of its own, in place of any other
+    if (profile){
+        interp = Interp_prog_profile;
+    }
+    if (fusionProfile){
+        interp = Interp_prog_sequences;
+    }
+
+    //Check number of arguments, that only one engine keeps the clock
+    //or makes a report, and that samples come from the threaded engine
+    int clocked = recordPath != NULL || (replayPath != NULL && replayCheck);
+    if (argc - argi != (restorePath == NULL) ||
+        (recordPath != NULL && replayPath != NULL) || (replayCheck && replayPath == NULL) ||
+        (clocked && (tracePath != NULL || samplePath != NULL)) ||
+        engine + profile + fusionProfile > 1 ||
+        ((profile || fusionProfile) && (clocked || tracePath != NULL)) ||
+        (samplePath != NULL && (interp != Interp_prog_threaded || tracePath != NULL))){
         fprintf(stderr,"Error, incorrect arguments.\n");
         exit(1);
     }
 
-    //Open the file
-    FILE *fp = fopen(argv[1],"rb");
-    if (fp == NULL){
-        fprintf(stderr,"Error opening file.\n");
-        exit(1);
+    Memseg_T program;
+    uint32_t registers[8] = { 0 };  //initialize registers
+    uint32_t pc = 0;                //and the program counter
+    if (restorePath != NULL){
+        program = Snapshot_read(restorePath, alloc, registers, &pc);
+    }
+    else if (cacheDir != NULL){
+        program = Cache_load(cacheDir, argv[argi], alloc, cacheSize);
+    }
+    else{
+
+        //Open the file; "-" reads the program from stdin
+        FILE *fp = stdin;
+        if (strcmp(argv[argi], "-") != 0){
+            fp = fopen(argv[argi],"rb");
+        }
+        if (fp == NULL){
+            fprintf(stderr,"Error opening file.\n");
+            exit(1);
+        }
+
+        program = Memseg_new(alloc);
+        Load_prog(fp, program);     //Read and load on-disk program
+        if (fp != stdin){
+            fclose(fp);             //Close the file
+        }
     }
 
     //Execute UM
-    Memseg_T program = Load_prog(fp);//Read and load on-disk program
-    fclose(fp);                     //Close the file
-    uint32_t registers[8] = { 0 };  //initialize registers
-    Interp_prog(program,registers); //interpret the program
+    Umio_T io = Umio_new(sink, outPath, threshold);
+    if (ring > 0){
+        Umio_async(io, ring);
+    }
+    uint64_t clock = 0;     //instructions run, under Interp_prog_clocked
+    if (recordPath != NULL){
+        Umio_record(io, recordPath, &clock);
+    }
+    if (replayPath != NULL){
+        Umio_replay(io, replayPath, replayCheck ? &clock : NULL);
+    }
+    Interp_status status = INTERP_STOPPED;
+    if (footprintPath != NULL){
+        Footprint_start(footprintPath, footprintInterval);
+    }
+    if (samplePath != NULL){
+        Sample_start(samplePath, sampleRate);
+    }
+    if (snapshotPath != NULL){
+        Snapshot_watch();
+        if (snapshotAt == UINT64_MAX && !snapshotAtInput && interp == Interp_prog_threaded &&
+            tracePath == NULL && !clocked){
+            status = Interp_prog_watched(program, registers, &pc, io, samplePath != NULL,
+                                         &Snapshot_requested);
+        }
+        else{
+            status = Interp_prog_until(program, registers, &pc, io, snapshotAt,
+                                       snapshotAtInput, &Snapshot_requested);
+        }
+        if (status == INTERP_STOPPED){
+            Snapshot_write(snapshotPath, program, registers, pc);
+            if (snapshotStop){
+                status = INTERP_HALTED;
+            }
+        }
+    }
+    if (status == INTERP_STOPPED && tracePath != NULL){
+        Trace trace;
+        Trace_init(&trace, tracePath, traceSize);
+        Trace_watch();
+        status = Interp_prog_traced(program, registers, &pc, io, &trace);
+        Trace_write(&trace, status, pc);
+        Trace_free(&trace);
+    }
+    if (status == INTERP_STOPPED && clocked){
+        status = Interp_prog_clocked(program, registers, &pc, io, &clock);
+    }
+    if (status == INTERP_STOPPED &&
+        (samplePath != NULL || (footprintPath != NULL && interp == Interp_prog_threaded))){
+        status = Interp_prog_watched(program, registers, &pc, io, samplePath != NULL, NULL);
+    }
+    if (status == INTERP_STOPPED){
+        status = interp(program,registers,&pc,io);//interpret the program
+    }
+    if (samplePath != NULL){
+        Sample_stop();              //write the samples
+    }
+    if (footprintPath != NULL){
+        Memseg_stats counters;
+        Memseg_get_stats(program, &counters);
+        Footprint_stop(&counters);  //write the footprint
+    }
+
+    //Flush the output, reporting its checksum if it was not kept
+    if (sink == UMIO_CHECKSUM){
+        uint64_t bytes;
+        uint64_t checksum = Umio_checksum(io, &bytes);
+        fprintf(stderr, "output checksum: %016" PRIx64 " (%" PRIu64 " bytes)\n",
+                checksum, bytes);
+    }
+    Umio_free(io);
+    if (status >= INTERP_FAULTED){
+        fprintf(stderr, "Error, %s at program counter %" PRIu32 ".\n",
+                Interp_fault(status), pc);
+        for (int i = 0; i < 8; ++i){
+            fprintf(stderr, "  r%d = %08" PRIx32 " (%" PRIu32 ")\n", i,
+                    registers[i], registers[i]);
+        }
+        exit(1);
+    }
+
+    //Report the memory counters
+    if (stats){
+        Memseg_stats counters;
+        Memseg_get_stats(program, &counters);
+        fprintf(stderr, "load program copies avoided: %" PRIu64 "\n", counters.copiesAvoided);
+        fprintf(stderr, "load program copies made:    %" PRIu64 "\n", counters.copiesMade);
+        fprintf(stderr, "load program bytes copied:   %" PRIu64 "\n", counters.bytesCopied);
+        fprintf(stderr, "allocator hits:              %" PRIu64 "\n", counters.allocHits);
+        fprintf(stderr, "allocator misses:            %" PRIu64 "\n", counters.allocMisses);
+        fprintf(stderr, "allocator bytes held:        %" PRIu64 "\n", counters.bytesHeld);
+        fprintf(stderr, "segments mapped (peak):      %" PRIu64 " (%" PRIu64 ")\n",
+                counters.segments, counters.peakSegments);
+        fprintf(stderr, "words mapped (peak):         %" PRIu64 " (%" PRIu64 ")\n",
+                counters.words, counters.peakWords);
+        fprintf(stderr, "maps, unmaps:                %" PRIu64 ", %" PRIu64 "\n",
+                counters.maps, counters.unmaps);
+        fprintf(stderr, "free IDs (peak):             %" PRIu64 " (%" PRIu64 ")\n",
+                counters.freeIds, counters.peakFreeIds);
+        fprintf(stderr, "host bytes (peak):           %" PRIu64 " (%" PRIu64 ")\n",
+                counters.hostBytes, counters.peakHostBytes);
+        fprintf(stderr, "dispatches saved by fusion:  %" PRIu64 "\n",
+                Interp_dispatches_saved());
+    }
     Memseg_free(program);           //Free the memory
 
     return 0;//Successful exit
 }
-/**********************************************************/
\ No newline at end of file
+/**********************************************************/
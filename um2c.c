@@ -0,0 +1,518 @@
+//Timothy Colaneri
+//Universal Machine ahead-of-time compiler to C
+
+/* um2c translates a .um image into one C source file which, linked
+against libum.a, is a native executable running that program. Each
+word of segment 0 that can run becomes a few lines of straight-line
+C working on eight local registers; the words where control can
+arrive from a load program get a label, and load programs between
+them become gotos, direct ones when the target is a constant.
+
+A word is taken as a jump target when a load value names it for
+what looks like a jump, when it follows a load program, which is
+where calls return to, or when constant folding shows a load program
+going to it; words that look like data are left out. The words that follow a jump
+target up to the next jump or halt are code; the others are data.
+A load program to any other PC, a load program from a segment other
+than 0, an undefined opcode, or a jump into a straight line of code
+a store has changed leaves the compiled code for good: the machine
+is handed as it stands to an embedded interpreter, which runs the
+program from there. So does a store into the straight line of code
+it is running. Stores into data stay compiled. The compiled code only checks what the fast
+engines check.
+
+Build a translated program with:
+    ./um2c --out=prog.c prog.um
+    gcc -O1 -fno-tree-pta -I. prog.c libum.a -lm -lpthread -o prog
+Points-to analysis is most of what gcc spends on a large program
+in one function, and buys it nothing here. */
+
+/**********************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<inttypes.h>
+#include"um_load.h"
+#include"um_decode.h"
+/**********************************************************/
+//A Known holds what is known of the registers at one word of a
+//block: register i holds 'value[i]' if bit i of 'mask' is set.
+//Nothing is known at a jump target.
+typedef struct Known {
+    unsigned mask;
+    uint32_t value[8];
+} Known;
+
+enum { CMOV, LOAD, STORE, ADD, MULT, DIV, NAND, HALT,
+       MAP, UNMAP, OUT, IN, LOADPROG, LOADVAL };
+
+#define SCAN 256  //words jump_value follows a register through
+/**********************************************************/
+//These track the registers that hold constants through a block
+static void known_set(Known *k, unsigned r, uint32_t value){
+    k->mask |= 1u << r;
+    k->value[r] = value;
+}
+static int known(const Known *k, unsigned r){
+    return (k->mask >> r) & 1;
+}
+//Function ends_block tells whether control never falls through
+//the word 'w' to the next
+static int ends_block(Codeword w){
+    return w.opcode == HALT || w.opcode == LOADPROG || w.opcode > LOADVAL;
+}
+//Function known_step updates 'k' for the word 'w', folding the
+//arithmetic on constants
+static void known_step(Known *k, Codeword w){
+    int both = known(k, w.b) && known(k, w.c);
+    switch (w.opcode){
+        case CMOV:
+            if (known(k, w.c) && k->value[w.c] == 0){
+                return;
+            }
+            if (known(k, w.c) && known(k, w.b)){
+                known_set(k, w.a, k->value[w.b]);
+                return;
+            }
+            break;
+        case ADD:
+            if (both){
+                known_set(k, w.a, k->value[w.b] + k->value[w.c]);
+                return;
+            }
+            break;
+        case MULT:
+            if (both){
+                known_set(k, w.a, k->value[w.b] * k->value[w.c]);
+                return;
+            }
+            break;
+        case NAND:
+            if (both){
+                known_set(k, w.a, ~(k->value[w.b] & k->value[w.c]));
+                return;
+            }
+            break;
+        case LOADVAL:
+            known_set(k, w.a, w.value);
+            return;
+        case MAP:
+            k->mask &= ~(1u << w.b);
+            return;
+        case IN:
+            k->mask &= ~(1u << w.c);
+            return;
+        case LOAD: case DIV:
+            break;
+        default:
+            return;                 //writes no register
+    }
+    k->mask &= ~(1u << w.a);
+}
+/**********************************************************/
+//Function target returns the PC the load program 'w' jumps to
+//when that is known to be a word of segment 0, or -1
+static int64_t target(const Known *k, Codeword w, uint32_t length){
+    if (known(k, w.b) && k->value[w.b] == 0 && known(k, w.c)
+        && k->value[w.c] < length){
+        return k->value[w.c];
+    }
+    return -1;
+}
+//Function jump_value guesses whether the load value at 'pc'
+//loads a jump target, from what its register is used for before
+//it is written again or the straight line of code ends: it is
+//one if it is jumped to, chosen by a conditional move or stored,
+//or passed on untouched to a jump, as return addresses are, and
+//not one if it is used as an offset, an operand or a segment. A
+//wrong guess costs speed, not correctness: a jump to a word that
+//is not a jump target goes to the interpreter.
+static int jump_value(const Codeword *code, uint32_t length, uint32_t pc){
+    unsigned r = code[pc].a;
+    int used = 0;
+    for (uint32_t i = pc + 1; i < length && i <= pc + SCAN; ++i){
+        Codeword w = code[i];
+        unsigned targets = 0, reads = 0, writes = 0;
+        switch (w.opcode){
+            case CMOV:     targets = 1u << w.a | 1u << w.b; break;
+            case LOAD:     reads = 1u << w.b | 1u << w.c; writes = 1u << w.a; break;
+            case STORE:    targets = 1u << w.c; reads = 1u << w.a | 1u << w.b; break;
+            case ADD: case MULT: case DIV: case NAND:
+                           reads = 1u << w.b | 1u << w.c; writes = 1u << w.a; break;
+            case MAP:      reads = 1u << w.c; writes = 1u << w.b; break;
+            case UNMAP: case OUT:
+                           reads = 1u << w.c; break;
+            case IN:       writes = 1u << w.c; break;
+            case LOADVAL:  writes = 1u << w.a; break;
+            case LOADPROG: return r == w.c || (!used && r != w.b);
+            default:       return 0;
+        }
+        if (targets & (1u << r)){
+            return 1;
+        }
+        used |= (reads >> r) & 1;
+        if (writes & (1u << r)){
+            return 0;
+        }
+    }
+    return !used;
+}
+//Function runs_into_data tells whether 'pc' is data whatever
+//points at it: the straight line of code from it reaches an
+//undefined opcode, or it starts with a word of 0, which no code
+//would, being a conditional move of r0 to itself
+static int runs_into_data(const Codeword *code, uint32_t length, uint32_t pc){
+    if (code[pc].opcode == CMOV && code[pc].a == 0 && code[pc].b == 0 && code[pc].c == 0){
+        return 1;
+    }
+    for (; pc < length && !ends_block(code[pc]); ++pc){
+    }
+    return pc < length && code[pc].opcode > LOADVAL;
+}
+//Function find_leaders marks in 'leader' every word of 'code'
+//that is a jump target. It starts from the constants the program
+//loads that jump_value takes for targets, then adds the targets that
+//constant folding finds until there are no more; each new target
+//only forgets constants, so this ends.
+static void find_leaders(const Codeword *code, uint32_t length, unsigned char *leader){
+    if (length > 0){
+        leader[0] = 1;
+    }
+    for (uint32_t pc = 0; pc < length; ++pc){
+        Codeword w = code[pc];
+        if (w.opcode == LOADVAL && w.value < length && jump_value(code, length, pc)
+            && !runs_into_data(code, length, w.value)){
+            leader[w.value] = 1;
+        }
+        if (w.opcode == LOADPROG && pc + 1 < length && !runs_into_data(code, length, pc + 1)){
+            leader[pc + 1] = 1;     //where a call returns to
+        }
+    }
+
+    int changed = 1;
+    while (changed){
+        changed = 0;
+        Known k = { 0, { 0 } };
+        for (uint32_t pc = 0; pc < length; ++pc){
+            if (leader[pc]){
+                k.mask = 0;
+            }
+            int64_t to = code[pc].opcode == LOADPROG ? target(&k, code[pc], length) : -1;
+            if (to >= 0 && !leader[to]){
+                leader[to] = 1;
+                changed = 1;
+            }
+            known_step(&k, code[pc]);
+        }
+    }
+}
+//Function find_code numbers in 'region' the words reached from a
+//jump target without a jump, which are the words translated, by
+//the straight line of code they lie in, from 1. The rest are
+//data, left 0, which the program may overwrite without leaving the
+//compiled code. It returns the number of regions.
+static uint32_t find_code(const Codeword *code, uint32_t length, const unsigned char *leader,
+                          uint32_t *region){
+    uint32_t regions = 0;
+    for (uint32_t pc = 0; pc < length; ++pc){
+        if (pc > 0 && region[pc - 1] != 0 && !ends_block(code[pc - 1])){
+            region[pc] = region[pc - 1];
+        }
+        else{
+            region[pc] = leader[pc] ? ++regions : 0;
+        }
+    }
+    return regions;
+}
+/**********************************************************/
+//Function emit_word writes the C for word 'pc' of 'code', where
+//'k' is what is known of the registers before it
+static void emit_word(FILE *out, Codeword w, uint32_t pc, const Known *k,
+                      uint32_t length, const uint32_t *region){
+    char text[64];
+    Decode_format(w, text, sizeof(text));
+    fprintf(out, "    /* %" PRIu32 ": %s */\n", pc, text);
+
+    unsigned a = w.a, b = w.b, c = w.c;
+    switch (w.opcode){
+        case CMOV:
+            fprintf(out, "    if (r%u != 0) r%u = r%u;\n", c, a, b);
+            break;
+        case LOAD:
+            fprintf(out, "    r%u = WORDS(r%u)[r%u];\n", a, b, c);
+            break;
+        case STORE:
+            fprintf(out, "    STORE(r%u, r%u, r%u, %" PRIu32 ", %" PRIu32 ");\n",
+                    a, b, c, region[pc], pc + 1);
+            break;
+        case ADD:
+            fprintf(out, "    r%u = r%u + r%u;\n", a, b, c);
+            break;
+        case MULT:
+            fprintf(out, "    r%u = r%u * r%u;\n", a, b, c);
+            break;
+        case DIV:
+            fprintf(out, "    r%u = r%u / r%u;\n", a, b, c);
+            break;
+        case NAND:
+            fprintf(out, "    r%u = ~(r%u & r%u);\n", a, b, c);
+            break;
+        case HALT:
+            fprintf(out, "    pc = %" PRIu32 "; goto done;\n", pc);
+            break;
+        case MAP:
+            fprintf(out, "    id = Memseg_map(program, r%u);\n"
+                         "    if (id == MEMSEG_NONE){ pc = %" PRIu32 "; status = INTERP_MEMORY; goto done; }\n"
+                         "    r%u = id;\n"
+                         "    table = Memseg_table(program);\n", c, pc, b);
+            break;
+        case UNMAP:
+            fprintf(out, "    if (!Memseg_unmap(program, r%u)){ pc = %" PRIu32 "; status = INTERP_UNMAPPED; goto done; }\n",
+                    c, pc);
+            break;
+        case OUT:
+            fprintf(out, "    Umio_put(io, r%u);\n", c);
+            break;
+        case IN:
+            fprintf(out, "    r%u = Umio_get(io);\n", c);
+            break;
+        case LOADPROG: {
+            int64_t to = target(k, w, length);
+            if (to >= 0){
+                fprintf(out, "    goto L%" PRId64 ";\n", to);
+                break;
+            }
+            fprintf(out, "    pc = r%u;\n", c);
+            if (!(known(k, b) && k->value[b] == 0)){
+                fprintf(out, "    if (r%u != 0){\n"
+                             "        if (!Memseg_load_prog(program, r%u)){ pc = %" PRIu32 "; status = INTERP_MEMORY; goto done; }\n"
+                             "        goto interpret;\n"
+                             "    }\n", b, b, pc);
+            }
+            fprintf(out, "    goto dispatch;\n");
+            break;
+        }
+        case LOADVAL:
+            fprintf(out, "    r%u = %" PRIu32 ";\n", a, w.value);
+            break;
+        default:                    //the interpreter decides
+            fprintf(out, "    pc = %" PRIu32 "; goto interpret;\n", pc);
+    }
+}
+/**********************************************************/
+//Function emit writes the whole C program for the image 'words'
+//of 'length' words, named 'name', handing over to the engine
+//'fallback'
+static void emit(FILE *out, const char *name, const uint32_t *words, uint32_t length,
+                 const char *fallback){
+    Codeword *code = malloc((length + 1) * sizeof(Codeword));
+    unsigned char *leader = calloc(length + 1, 1);
+    uint32_t *region = calloc(length + 1, sizeof(uint32_t));
+    if (code == NULL || leader == NULL || region == NULL){
+        fprintf(stderr, "Error, out of memory.\n");
+        exit(1);
+    }
+    Decode_words(words, code, length);
+    find_leaders(code, length, leader);
+    uint32_t regions = find_code(code, length, leader, region);
+
+    //The image itself, big-endian as on disk, so the machine is
+    //loaded the same way um loads it
+    fprintf(out, "/* Translated from %s by um2c */\n"
+                 "#include<stdio.h>\n"
+                 "#include<stdlib.h>\n"
+                 "#include<inttypes.h>\n"
+                 "#include\"um_load.h\"\n"
+                 "#include\"um_exec.h\"\n\n"
+                 "static const unsigned char image[%" PRIu32 "] = {\n",
+            name, length * 4 > 0 ? length * 4 : 1);
+    for (uint32_t pc = 0; pc < length; ++pc){
+        fprintf(out, "%s0x%02x,0x%02x,0x%02x,0x%02x,%s", pc % 4 == 0 ? "    " : "",
+                (unsigned)(words[pc] >> 24), (unsigned)(words[pc] >> 16) & 0xff,
+                (unsigned)(words[pc] >> 8) & 0xff, (unsigned)words[pc] & 0xff,
+                pc % 4 == 3 || pc + 1 == length ? "\n" : "");
+    }
+    fprintf(out, "};\n\n"
+                 "//The straight line of code each word was translated in, or\n"
+                 "//0 for data, and whether a store has changed each since\n"
+                 "static const uint32_t region[%" PRIu32 "] = {",
+            length > 0 ? length : 1);
+    for (uint32_t pc = 0; pc < length; ++pc){
+        fprintf(out, "%s%" PRIu32 ",", pc % 16 == 0 ? "\n    " : "", region[pc]);
+    }
+    fprintf(out, "\n};\n"
+                 "static unsigned char dirty[%" PRIu32 "];\n\n", regions + 1);
+
+    //Loads and stores through the segment table, as the JIT makes
+    //them; a store that needs Memseg_store is made out of line
+    fprintf(out, "#define WORDS(s) ((uint32_t *)((table[s] & ~(uintptr_t)MEMSEG_FLAGS) + MEMSEG_WORDS))\n"
+                 "#define STORE(a, b, c, here, next)                        \\\n"
+                 "    do { if (table[a] & MEMSEG_FLAGS){                   \\\n"
+                 "             int changed = store(program, a, b, c, here);\\\n"
+                 "             if (changed < 0){                           \\\n"
+                 "                 pc = next - 1; status = INTERP_MEMORY;  \\\n"
+                 "                 goto done;                              \\\n"
+                 "             }                                           \\\n"
+                 "             if (changed){                               \\\n"
+                 "                 pc = next; goto interpret;              \\\n"
+                 "             }                                           \\\n"
+                 "         }                                               \\\n"
+                 "         else WORDS(a)[b] = c; } while (0)\n\n"
+                 "//Function store stores 'c' at offset 'b' of segment 'a', marking\n"
+                 "//the code it changes, and tells whether that is region 'here',\n"
+                 "//or returns -1 if there was no memory to store it\n"
+                 "static inline int store(Memseg_T program, uint32_t a, uint32_t b, uint32_t c,\n"
+                 "                        uint32_t here){\n"
+                 "    if (!Memseg_store(program, c, a, b)){\n"
+                 "        return -1;\n"
+                 "    }\n"
+                 "    if (a == 0 && b < sizeof(region) / sizeof(region[0]) && region[b] != 0){\n"
+                 "        dirty[region[b]] = 1;\n"
+                 "        return region[b] == here;\n"
+                 "    }\n"
+                 "    return 0;\n"
+                 "}\n\n");
+
+    //The machine, and the dispatch of computed jumps
+    fprintf(out, "int main(void){\n"
+                 "    Memseg_T program = Memseg_new(MEMSEG_SLAB);\n"
+                 "    Load_image(image, %" PRIu32 ", program);\n"
+                 "    Umio_T io = Umio_new(UMIO_STDOUT, NULL, UMIO_THRESHOLD);\n"
+                 "    uintptr_t *table = Memseg_table(program);\n"
+                 "    (void)table;\n"
+                 "    uint32_t r0 = 0, r1 = 0, r2 = 0, r3 = 0, r4 = 0, r5 = 0, r6 = 0, r7 = 0;\n"
+                 "    uint32_t pc = 0;\n"
+                 "    uint32_t id;\n"
+                 "    (void)id;\n"
+                 "    Interp_status status = INTERP_HALTED;\n"
+                 "    goto dispatch;\n\n"
+                 "dispatch:\n"
+                 "    switch (pc){\n",
+            length * 4);
+    for (uint32_t pc = 0; pc < length; ++pc){
+        if (leader[pc]){
+            fprintf(out, "        case %" PRIu32 ": goto L%" PRIu32 ";\n", pc, pc);
+        }
+    }
+    fprintf(out, "    }\n"
+                 "    goto interpret;\n\n");
+
+    //The code, one word at a time
+    Known k = { 0, { 0 } };
+    for (uint32_t pc = 0; pc < length; ++pc){
+        if (region[pc] == 0){
+            continue;
+        }
+        if (leader[pc]){
+            fprintf(out, "L%" PRIu32 ":\n"
+                         "    if (dirty[%" PRIu32 "]){ pc = %" PRIu32 "; goto interpret; }\n",
+                    pc, region[pc], pc);
+            k.mask = 0;
+        }
+        emit_word(out, code[pc], pc, &k, length, region);
+        known_step(&k, code[pc]);
+    }
+    fprintf(out, "    pc = %" PRIu32 ";\n\n", length);
+
+    //Everything the compiled code cannot follow
+    fprintf(out, "interpret: {\n"
+                 "        uint32_t registers[8] = { r0, r1, r2, r3, r4, r5, r6, r7 };\n"
+                 "        status = %s(program, registers, &pc, io);\n"
+                 "        r0 = registers[0]; r1 = registers[1]; r2 = registers[2]; r3 = registers[3];\n"
+                 "        r4 = registers[4]; r5 = registers[5]; r6 = registers[6]; r7 = registers[7];\n"
+                 "        goto done;\n"
+                 "    }\n\n"
+                 "done:\n"
+                 "    Umio_free(io);\n"
+                 "    if (status >= INTERP_FAULTED){\n"
+                 "        uint32_t registers[8] = { r0, r1, r2, r3, r4, r5, r6, r7 };\n"
+                 "        fprintf(stderr, \"Error, %%s at program counter %%\" PRIu32 \".\\n\",\n"
+                 "                Interp_fault(status), pc);\n"
+                 "        for (int i = 0; i < 8; ++i){\n"
+                 "            fprintf(stderr, \"  r%%d = %%08\" PRIx32 \" (%%\" PRIu32 \")\\n\", i,\n"
+                 "                    registers[i], registers[i]);\n"
+                 "        }\n"
+                 "        exit(1);\n"
+                 "    }\n"
+                 "    Memseg_free(program);\n"
+                 "    return 0;\n"
+                 "}\n",
+            fallback);
+
+    free(region);
+    free(leader);
+    free(code);
+}
+/**********************************************************/
+//This main function reads the image named by its argument, or
+//by "-" for stdin, and writes its translation. Options come
+//before the image:
+//  --out=FILE                where the C goes, stdout by default
+//  --fallback=threaded|switch|checked
+//                            the engine that runs what the
+//                            compiled code cannot, threaded by
+//                            default; checked reports faults
+//                            the way um --engine=checked does
+int main(int argc, char *argv[]){
+    const char *outPath = NULL;
+    const char *fallback = "Interp_prog_threaded";
+    int argi = 1;
+
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi){
+        if (strncmp(argv[argi], "--out=", 6) == 0){
+            outPath = argv[argi] + 6;
+        }
+        else if (strcmp(argv[argi], "--fallback=threaded") == 0){
+            fallback = "Interp_prog_threaded";
+        }
+        else if (strcmp(argv[argi], "--fallback=switch") == 0){
+            fallback = "Interp_prog";
+        }
+        else if (strcmp(argv[argi], "--fallback=checked") == 0){
+            fallback = "Interp_prog_checked";
+        }
+        else{
+            fprintf(stderr, "Error, unknown option %s.\n", argv[argi]);
+            exit(1);
+        }
+    }
+    if (argc - argi != 1){
+        fprintf(stderr, "usage: um2c [--out=FILE] [--fallback=threaded|switch|checked] IMAGE\n");
+        exit(1);
+    }
+
+    //Load the image the way um does
+    FILE *fp = stdin;
+    if (strcmp(argv[argi], "-") != 0){
+        fp = fopen(argv[argi], "rb");
+    }
+    if (fp == NULL){
+        fprintf(stderr, "Error opening file.\n");
+        exit(1);
+    }
+    Memseg_T program = Memseg_new(MEMSEG_MALLOC);
+    Load_prog(fp, program);
+    if (fp != stdin){
+        fclose(fp);
+    }
+    uint32_t length;
+    const uint32_t *words = Memseg_segment(program, 0, &length);
+
+    FILE *out = stdout;
+    if (outPath != NULL){
+        out = fopen(outPath, "w");
+        if (out == NULL){
+            fprintf(stderr, "Error opening %s.\n", outPath);
+            exit(1);
+        }
+    }
+    emit(out, argv[argi], words, length, fallback);
+    if (fclose(out) != 0){
+        fprintf(stderr, "Error writing the translation.\n");
+        exit(1);
+    }
+
+    Memseg_free(program);
+    return 0;
+}
+/**********************************************************/
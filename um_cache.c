@@ -0,0 +1,435 @@
+//Timothy Colaneri
+//Universal Machine image cache implementation
+
+/* An entry is a Header followed by the memory section Memseg_save
+writes for a memory space holding segment 0 alone, then, from a
+multiple of 16, segment 0's Codewords and one spare, as Memseg_decode
+leaves them. The Header is padded to 64 bytes like a snapshot's, so
+the segment lands on the boundary Memseg_restore needs when the entry
+is mapped.
+
+A load still reads and hashes the whole image, since the image is its
+own key, and hashes the entry too, to catch one damaged on disk, but
+no longer converts the image to host order, decodes or fuses it.
+An entry that is used gets its modification time set to now, so the
+entries trimmed first are those used least recently. Entries are
+written under a name of the writing process's own and renamed into
+place, so machines starting on one image together never see each
+other's half written entry. A partial entry left behind by a process
+that died writing it is removed by the next trim once it is STALE
+seconds old, long past any write still in progress. The cache only
+saves work: an entry that cannot be written is reported and the
+machine runs all the same. */
+
+/**********************************************************************/
+#define _XOPEN_SOURCE 700   //mmap, futimens, st_mtim
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<ctype.h>
+#include<time.h>
+#include<assert.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<dirent.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include"um_cache.h" //Own header
+#include"um_load.h"
+#include"um_fuse.h"
+/**********************************************************************/
+#define MAGIC   "UMCACHE"    //first 8 bytes of an entry, with the NUL
+#define ORDER   0x01020304u  //reads back differently in another byte order
+#define VERSION 2            //raised when the layout of an entry changes
+#define HEADER  64           //bytes before the memory section
+#define ALIGNMENT 16         //of the memory section and the Codewords
+#define BLOCKSIZE (1 << 20)  //bytes asked of each read on a pipe
+#define STALE   600          //seconds until a partial entry is abandoned
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+//A Header opens every entry. 'decoder' is the fingerprint of the
+//decoder that wrote it, and 'hash' and 'imageSize' describe the image
+//it was made from. The Codewords start 'code' bytes in, and there
+//are 'codeWords' of them. 'body' is the hash of everything after the
+//Header, so an entry damaged since it was written is not run.
+typedef struct Header {
+    char magic[8];
+    uint32_t order;
+    uint32_t version;
+    uint64_t decoder;
+    uint64_t hash;
+    uint64_t imageSize;
+    uint64_t code;
+    uint64_t codeWords;
+    uint64_t body;
+} Header;
+typedef char check_header[sizeof(Header) == HEADER ? 1 : -1];
+
+//An Image is a program image as it lies on disk, 'size' bytes at
+//'bytes', which are mapped from its file or read into memory
+typedef struct Image {
+    unsigned char *bytes;
+    size_t size;
+    int mapped;
+} Image;
+
+//An Entry is one file of the cache directory, while it is trimmed
+typedef struct Entry {
+    char *path;
+    off_t size;
+    struct timespec used;
+} Entry;
+/**********************************************************************/
+//Function hash_bytes folds the 'size' bytes at 'bytes' into 'hash',
+//FNV-1a fashion but eight bytes a step, with a shift folding the
+//high bits of each step back down
+static uint64_t hash_bytes(uint64_t hash, const unsigned char *bytes, size_t size){
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8){
+        uint64_t chunk;
+        memcpy(&chunk, bytes + i, sizeof(chunk));
+        hash = (hash ^ chunk) * FNV_PRIME;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i){
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+/**********************************************************************/
+//Function decoder returns the fingerprint of the decoder: the hash of
+//what Decode_words and Decode_fuse make of every opcode and of every
+//sequence in FUSE_SEQUENCES, each ended by a halt. A change to either,
+//or to the layout of a Codeword, changes it and makes every entry
+//stale.
+#define WORD(op) ((uint32_t)(op) << 28 | 0x1d1u)
+#define PROBE_PAIR(x, y) WORD(x), WORD(y), WORD(7),
+#define PROBE_TRIPLE(x, y, z) WORD(x), WORD(y), WORD(z), WORD(7),
+static uint64_t decoder(void){
+    static const uint32_t probe[] = {
+        WORD(0), WORD(1), WORD(2), WORD(3), WORD(4), WORD(5), WORD(6), WORD(7),
+        WORD(8), WORD(9), WORD(10), WORD(11), WORD(12), WORD(13), WORD(14), WORD(15),
+        FUSE_SEQUENCES(PROBE_PAIR, PROBE_TRIPLE)
+    };
+    uint32_t length = sizeof(probe) / sizeof(probe[0]);
+    Codeword code[sizeof(probe) / sizeof(probe[0])];
+    Decode_words(probe, code, length);
+    Decode_fuse(code, length);
+    return hash_bytes(FNV_OFFSET ^ sizeof(Codeword), (const unsigned char *)code,
+                      sizeof(code));
+}
+#undef WORD
+#undef PROBE_PAIR
+#undef PROBE_TRIPLE
+/**********************************************************************/
+//Function read_image maps the image in the file 'path', or reads it
+//from stdin or any other file that cannot be mapped
+static void read_image(const char *path, Image *image){
+    int fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0){
+        fprintf(stderr, "Error opening file.\n");
+        exit(1);
+    }
+
+    image->mapped = 0;
+    if (S_ISREG(info.st_mode) && info.st_size > 0){
+        image->size = (size_t)info.st_size;
+        image->bytes = mmap(NULL, image->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        image->mapped = image->bytes != MAP_FAILED;
+    }
+    if (!image->mapped){
+        size_t capacity = BLOCKSIZE;
+        image->size = 0;
+        image->bytes = malloc(capacity);
+        assert(image->bytes);
+        ssize_t got;
+        while ((got = read(fd, image->bytes + image->size, capacity - image->size)) != 0){
+            if (got < 0){
+                if (errno == EINTR){
+                    continue;
+                }
+                fprintf(stderr, "Error reading program: %s.\n", strerror(errno));
+                exit(1);
+            }
+            image->size += (size_t)got;
+            if (image->size == capacity){
+                capacity *= 2;
+                image->bytes = realloc(image->bytes, capacity);
+                assert(image->bytes);
+            }
+        }
+    }
+    if (fd != STDIN_FILENO){
+        close(fd);
+    }
+}
+/**********************************************************************/
+//Function entry_path returns the name of the entry for the image
+//with hash 'hash' in 'dir', for the caller to free
+static char *entry_path(const char *dir, uint64_t hash){
+    size_t size = strlen(dir) + 1 + 16 + sizeof(CACHE_SUFFIX);
+    char *path = malloc(size);
+    assert(path);
+    snprintf(path, size, "%s/%016" PRIx64 CACHE_SUFFIX, dir, hash);
+    return path;
+}
+/**********************************************************************/
+//Function try_entry returns the memory space held by the entry at
+//'path' for an image of 'imageSize' bytes hashed to 'hash', or NULL
+//if there is no such entry. A stale or damaged entry is removed. The
+//entry is mapped privately, so stores into segment 0 and the
+//Codewords they mark stale are the machine's own.
+static Memseg_T try_entry(const char *path, size_t imageSize, uint64_t hash,
+                          Memseg_alloc policy){
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0){
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)){
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    size_t size = (size_t)info.st_size;
+    unsigned char *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED){
+        close(fd);
+        return NULL;
+    }
+
+    Header header;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+        header.order != ORDER || header.version != VERSION ||
+        header.decoder != decoder() || header.hash != hash ||
+        header.imageSize != imageSize ||
+        header.code % ALIGNMENT != 0 || header.code > size ||
+        header.codeWords != (imageSize / sizeof(uint32_t)) + 1 ||
+        header.codeWords * sizeof(Codeword) != size - header.code ||
+        header.body != hash_bytes(FNV_OFFSET, image + HEADER, size - HEADER)){
+        munmap(image, size);
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    //Segment 0 has to be the one the Codewords were decoded from
+    uint32_t length = 0;
+    Memseg_T program = Memseg_try_restore(policy, image, size, HEADER);
+    if (program != NULL){
+        Memseg_segment(program, 0, &length);
+    }
+    if (program == NULL || length != header.codeWords - 1){
+        if (program != NULL){
+            Memseg_free(program);   //unmaps the image
+        }
+        else{
+            munmap(image, size);
+        }
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    futimens(fd, NULL);     //used now
+    close(fd);
+    Memseg_decoded(program, (Codeword *)(image + header.code));
+    return program;
+}
+/**********************************************************************/
+//Function hash_body stores into 'body' the hash of what has been
+//written to 'fp' after the Header, reading it back from the file. It
+//returns 0 if the file cannot be read.
+static int hash_body(FILE *fp, uint64_t *body){
+    long size = ftell(fp);
+    if (size < HEADER){
+        return 0;
+    }
+    unsigned char *bytes = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (bytes == MAP_FAILED){
+        return 0;
+    }
+    *body = hash_bytes(FNV_OFFSET, bytes + HEADER, (size_t)size - HEADER);
+    munmap(bytes, (size_t)size);
+    return 1;
+}
+/**********************************************************************/
+//Function write_entry writes the entry for 'program', freshly loaded
+//and decoded from an image of 'imageSize' bytes hashed to 'hash', to
+//'path' in 'dir'. It returns 0 if it could not.
+static int write_entry(const char *dir, const char *path, Memseg_T program,
+                       size_t imageSize, uint64_t hash){
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST){
+        return 0;
+    }
+    size_t length = strlen(path) + 32;
+    char *partial = malloc(length);
+    assert(partial);
+    snprintf(partial, length, "%s.%ld", path, (long)getpid());
+
+    FILE *fp = fopen(partial, "w+b");  //read back by hash_body
+    if (fp == NULL){
+        free(partial);
+        return 0;
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, fp);
+    size_t written = sizeof(header) + Memseg_save(program, fp);
+
+    //The Codewords, with a zeroed spare
+    static const unsigned char zeros[ALIGNMENT];
+    size_t code = (written + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    fwrite(zeros, 1, code - written, fp);
+    uint32_t words;
+    Codeword *codewords = Memseg_code(program, &words);
+    Codeword spare = { 0, 0, 0, 0, 0 };
+    fwrite(codewords, sizeof(Codeword), words, fp);
+    fwrite(&spare, sizeof(spare), 1, fp);
+
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.order = ORDER;
+    header.version = VERSION;
+    header.decoder = decoder();
+    header.hash = hash;
+    header.imageSize = imageSize;
+    header.code = code;
+    header.codeWords = (uint64_t)words + 1;
+    int ok = fflush(fp) == 0 && hash_body(fp, &header.body);
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, fp);
+
+    ok = !ferror(fp) && ok;
+    ok = fclose(fp) == 0 && ok && rename(partial, path) == 0;
+    if (!ok){
+        unlink(partial);
+    }
+    free(partial);
+    return ok;
+}
+/**********************************************************************/
+//Function by_use orders Entries from the least recently used
+static int by_use(const void *x, const void *y){
+    const Entry *a = x, *b = y;
+    if (a->used.tv_sec != b->used.tv_sec){
+        return a->used.tv_sec < b->used.tv_sec ? -1 : 1;
+    }
+    return (a->used.tv_nsec > b->used.tv_nsec) - (a->used.tv_nsec < b->used.tv_nsec);
+}
+/**********************************************************************/
+//Function is_partial reports whether the file 'name' is a partial
+//entry, named for its entry and then the process writing it
+static int is_partial(const char *name){
+    const char *pid = strstr(name, CACHE_SUFFIX ".");
+    if (pid == NULL){
+        return 0;
+    }
+    pid += strlen(CACHE_SUFFIX) + 1;
+    if (*pid == '\0'){
+        return 0;
+    }
+    for (; *pid != '\0'; ++pid){
+        if (!isdigit((unsigned char)*pid)){
+            return 0;
+        }
+    }
+    return 1;
+}
+/**********************************************************************/
+//Function trim removes the partial entries of 'dir' that are stale,
+//then the entries used least recently until the others take 'limit'
+//bytes or fewer, sparing the entry 'keep'
+static void trim(const char *dir, uint64_t limit, const char *keep){
+    DIR *d = opendir(dir);
+    if (d == NULL){
+        return;
+    }
+    size_t count = 0, capacity = 16;
+    Entry *entries = malloc(capacity * sizeof(Entry));
+    assert(entries);
+    uint64_t total = 0;
+    size_t suffix = strlen(CACHE_SUFFIX);
+    time_t now = time(NULL);
+
+    struct dirent *found;
+    while ((found = readdir(d)) != NULL){
+        size_t length = strlen(found->d_name);
+        int partial = is_partial(found->d_name);
+        if (!partial && (length <= suffix ||
+                         strcmp(found->d_name + length - suffix, CACHE_SUFFIX) != 0)){
+            continue;
+        }
+        char *path = malloc(strlen(dir) + length + 2);
+        assert(path);
+        sprintf(path, "%s/%s", dir, found->d_name);
+        struct stat info;
+        if (stat(path, &info) != 0){
+            free(path);
+            continue;
+        }
+        if (partial){
+            if (now - info.st_mtim.tv_sec > STALE){
+                unlink(path);
+            }
+            free(path);
+            continue;
+        }
+        if (count == capacity){
+            capacity *= 2;
+            entries = realloc(entries, capacity * sizeof(Entry));
+            assert(entries);
+        }
+        entries[count].path = path;
+        entries[count].size = info.st_size;
+        entries[count].used = info.st_mtim;
+        ++count;
+        total += (uint64_t)info.st_size;
+    }
+    closedir(d);
+
+    qsort(entries, count, sizeof(Entry), by_use);
+    for (size_t i = 0; i < count; ++i){
+        if (total > limit && strcmp(entries[i].path, keep) != 0 &&
+            unlink(entries[i].path) == 0){
+            total -= (uint64_t)entries[i].size;
+        }
+        free(entries[i].path);
+    }
+    free(entries);
+}
+/**********************************************************************/
+//Function Cache_load hashes the image, tries its entry, and on a miss
+//loads the image itself and writes the entry for the next time
+extern Memseg_T Cache_load(const char *dir, const char *path, Memseg_alloc policy,
+                           uint64_t limit){
+    Image image;
+    read_image(path, &image);
+    uint64_t hash = hash_bytes(FNV_OFFSET, image.bytes, image.size);
+    char *entry = entry_path(dir, hash);
+
+    Memseg_T program = try_entry(entry, image.size, hash, policy);
+    if (program == NULL){
+        program = Memseg_new(policy);
+        Load_image(image.bytes, image.size, program);
+        if (write_entry(dir, entry, program, image.size, hash)){
+            trim(dir, limit, entry);
+        }
+        else{
+            fprintf(stderr, "Error writing cache entry %s, carrying on without it.\n",
+                    entry);
+        }
+    }
+
+    if (image.mapped){
+        munmap(image.bytes, image.size);
+    }
+    else{
+        free(image.bytes);
+    }
+    free(entry);
+    return program;
+}
+/**********************************************************************/
@@ -0,0 +1,33 @@
+//Timothy Colaneri
+//Universal Machine image cache interface
+
+/**********************************************************************/
+#ifndef CACHE_INCLUDED
+#define CACHE_INCLUDED
+#include <inttypes.h>
+#include "um_mem.h"
+/**********************************************************************/
+//An image cache is a directory of files, one for each program image
+//loaded through it, named by the 64 bit hash of the image's contents
+//in hex with the suffix ".umc". Each holds segment 0 as Memseg_save
+//lays it out, followed by its predecoded and fused Codewords, so a
+//later load of the same image maps the file and runs from it in place
+//of converting and decoding the image again. An entry written by an
+//older decoder, a different superinstruction table or a machine of
+//another byte order is stale, and is replaced, as is one whose
+//contents no longer match the hash it was written with.
+#define CACHE_SUFFIX ".umc"
+#define CACHE_LIMIT (256ull << 20) //bytes of entries kept by default
+/**********************************************************************/
+extern Memseg_T Cache_load(const char *dir, const char *path, Memseg_alloc policy,
+                           uint64_t limit);
+//Cache_load returns a predecoded memory space holding the program
+//image in the file 'path', or on stdin for "-", that allocates new
+//segments under 'policy'. It takes segment 0 from the entry for the
+//image in the cache directory 'dir' if there is one, and otherwise
+//loads the image as Load_prog does and adds the entry, creating 'dir'
+//if need be, then removes the entries used least recently until the
+//others take 'limit' bytes or fewer, along with any partial entry a
+//writer abandoned long ago.
+/**********************************************************************/
+#endif
@@ -0,0 +1,130 @@
+//Timothy Colaneri
+//Universal Machine instruction decoder implementation
+
+/**********************************************************************/
+#include<stdio.h>     //snprintf
+#include"bitbatch.h"  //Batched bit fields
+#include"um_decode.h" //Own header
+#include"um_fuse.h"   //Superinstruction table
+#include"um_ops.h"    //Opcode table
+/**********************************************************************/
+#define DECODE_BLOCK 1024 //words Decode_words unpacks a batch at a time
+
+//The opcodes of each superinstruction, padded with DECODE_STALE
+#define SEQUENCE2(x, y)    { x, y, DECODE_STALE },
+#define SEQUENCE3(x, y, z) { x, y, z },
+static const uint8_t sequences[][FUSE_SPAN] = {
+    FUSE_SEQUENCES(SEQUENCE2, SEQUENCE3)
+};
+#undef SEQUENCE2
+#undef SEQUENCE3
+#define SEQUENCES (sizeof(sequences) / sizeof(sequences[0]))
+
+//The plain opcodes map to themselves and the superinstructions, which
+//follow DECODE_STALE in the order of FUSE_SEQUENCES, to their first
+#define HEAD2(x, y)    x,
+#define HEAD3(x, y, z) x,
+const uint8_t Decode_heads[256] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, DECODE_STALE,
+    FUSE_SEQUENCES(HEAD2, HEAD3)
+};
+#undef HEAD2
+#undef HEAD3
+/**********************************************************************/
+//Function Decode_word takes in a 32 bit word and returns a Codeword
+//populated with the values found within the passed in word, which
+//Bitbatch_um unpacks as a batch of one.
+extern Codeword Decode_word(uint32_t word){
+    Codeword codeword;
+    Bitbatch_fields fields = { &codeword.opcode, &codeword.a, &codeword.b,
+                               &codeword.c, &codeword.value };
+    Bitbatch_um(&word, 1, fields);
+    return codeword;
+}
+/**********************************************************************/
+//Function Decode_words unpacks a whole run of instruction words, such
+//as a freshly loaded segment 0, into the passed in Codeword array. The
+//words are unpacked DECODE_BLOCK at a time by Bitbatch_um into arrays
+//of each field that stay in cache, then gathered into Codewords.
+extern void Decode_words(const uint32_t *words, Codeword *code, uint32_t length){
+    uint8_t opcode[DECODE_BLOCK], a[DECODE_BLOCK], b[DECODE_BLOCK], c[DECODE_BLOCK];
+    uint32_t value[DECODE_BLOCK];
+    Bitbatch_fields fields = { opcode, a, b, c, value };
+
+    for (uint32_t start = 0; start < length; start += DECODE_BLOCK){
+        uint32_t n = length - start < DECODE_BLOCK ? length - start : DECODE_BLOCK;
+        Bitbatch_um(words + start, n, fields);
+        for (uint32_t i = 0; i < n; ++i){
+            code[start + i] = (Codeword){ opcode[i], a[i], b[i], c[i], value[i] };
+        }
+    }
+}
+/**********************************************************************/
+//Function Decode_format prints a Codeword in the order of its operands
+//in the UM specification, naming the opcode by its mnemonic.
+extern void Decode_format(Codeword word, char *text, size_t size){
+#define NAME(n, name, check) #name,
+    static const char *const names[16] = { UM_OPCODES(NAME) };
+#undef NAME
+
+    switch (word.opcode){
+        case 7:                 //No operands
+            snprintf(text, size, "%s", names[word.opcode]);
+            break;
+        case 8:                 //Segment ID into b, length in c
+        case 12:                //Segment in b, counter in c
+            snprintf(text, size, "%s r%u, r%u", names[word.opcode],
+                     word.b, word.c);
+            break;
+        case 9:                 //One register, c
+        case 10:
+        case 11:
+            snprintf(text, size, "%s r%u", names[word.opcode], word.c);
+            break;
+        case 13:
+            snprintf(text, size, "%s r%u, %" PRIu32, names[word.opcode],
+                     word.a, word.value);
+            break;
+        default:
+            if (word.opcode < 7){
+                snprintf(text, size, "%s r%u, r%u, r%u", names[word.opcode],
+                         word.a, word.b, word.c);
+            }
+            else{
+                snprintf(text, size, "op%u", word.opcode);
+            }
+    }
+}
+/**********************************************************************/
+//Function Decode_fuse scans the Codewords front to back, so the words
+//after the current one still hold their plain opcodes when it is
+//matched against each sequence.
+extern void Decode_fuse(Codeword *code, uint32_t length){
+    for (uint32_t i = 0; i < length; ++i){
+        for (uint32_t s = 0; s < SEQUENCES; ++s){
+            uint32_t n = Decode_fused_length(DECODE_FUSED + s);
+            uint32_t k = 0;
+            while (k < n && i + k < length &&
+                   code[i + k].opcode == sequences[s][k]){
+                ++k;
+            }
+            if (k == n){
+                code[i].opcode = DECODE_FUSED + s;
+                break;
+            }
+        }
+    }
+}
+/**********************************************************************/
+//Function Decode_fused_length counts the opcodes of a superinstruction
+extern uint32_t Decode_fused_length(uint8_t opcode){
+    if (opcode < DECODE_FUSED || opcode >= DECODE_FUSED + SEQUENCES){
+        return 1;
+    }
+    uint32_t n = 0;
+    while (n < FUSE_SPAN && sequences[opcode - DECODE_FUSED][n] != DECODE_STALE){
+        ++n;
+    }
+    return n;
+}
+/**********************************************************************/
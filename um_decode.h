@@ -0,0 +1,52 @@
+//Timothy Colaneri
+//Universal Machine instruction decoder interface
+
+/**********************************************************************/
+#ifndef DECODE_INCLUDED
+#define DECODE_INCLUDED
+#include <inttypes.h>
+#include <stddef.h>
+/**********************************************************************/
+//In the world of ideas, struct Codeword represents a intruction word in
+//a universal machine format, already unpacked. The opcode names the
+//operation and a, b and c name its registers. A load value instruction
+//keeps its target register in 'a' and its 25 bit immediate in 'value'.
+//Unpacking each word once and keeping the result in this compact form
+//lets the interpreter skip the bitpack module on every fetch.
+typedef struct Codeword {
+    uint8_t opcode, a, b, c;
+    uint32_t value;
+} Codeword;
+//A Codeword whose opcode is DECODE_STALE no longer matches the word it
+//was decoded from, because that word has since been overwritten. It
+//has to be decoded again before it is executed.
+#define DECODE_STALE 16
+//Opcodes from DECODE_FUSED up name superinstructions, one for each
+//sequence in FUSE_SEQUENCES, in order. A Codeword with such an opcode
+//starts the fused sequence and keeps the registers of its own word.
+#define DECODE_FUSED (DECODE_STALE + 1)
+/**********************************************************************/
+extern Codeword Decode_word(uint32_t word);
+//Decode_word unpacks a single 32 bit instruction word into a Codeword
+extern void Decode_words(const uint32_t *words, Codeword *code, uint32_t length);
+//Decode_words unpacks 'length' instruction words from 'words' into the
+//array 'code', which must have room for 'length' Codewords
+extern void Decode_format(Codeword word, char *text, size_t size);
+//Decode_format writes the assembly form of 'word', such as
+//"add r1, r2, r3", into the 'size' bytes at 'text'. A fused or
+//stale opcode is shown by its number.
+extern void Decode_fuse(Codeword *code, uint32_t length);
+//Decode_fuse rewrites the opcode of each Codeword in 'code' that
+//starts one of the sequences in FUSE_SEQUENCES into the matching
+//superinstruction. Words after it keep their own opcode, so a jump
+//into the middle of a sequence still works.
+extern const uint8_t Decode_heads[256];
+//Decode_heads[opcode] is the opcode of the first instruction of the
+//superinstruction 'opcode', and any other opcode up to DECODE_STALE
+//unchanged. It is a table so that engines executing one word at a
+//time can look it up on every fetch.
+extern uint32_t Decode_fused_length(uint8_t opcode);
+//Decode_fused_length returns the number of words the superinstruction
+//'opcode' executes, or 1 for any other opcode
+/**********************************************************************/
+#endif
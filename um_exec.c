@@ -2,211 +2,668 @@
 //Universal Machine interpreter implementation
 
 /************************************************************************************/
-#include"bitpack.h"
 #include"um_exec.h"
+#include"um_fuse.h"
+#include"um_ops.h"
+#include"um_profile.h"
+#include"um_sample.h"
+#include"um_footprint.h"
 #include<stdlib.h>
 #include<stdio.h>
 /************************************************************************************/
-//In the world of ideas, struct Codeword represents a intruction word in a universal
-//machine format. The integer opcode represents the operation code and a, b, and c
-//represent the different values found within the word. This should be a checkable
-// property throught execution of a program.
-//
-typedef struct Codeword {
-    unsigned opcode, a, b, c;
-}Codeword;
 /*************************************************************************PROTOTYPES*/
-static Codeword get_codeword(uint32_t word, Codeword codeword);
-static void interp_word(Codeword word, unsigned *registers, Memseg_T program, unsigned * idx);
-
-//In the world of ideas, a program can be represented as a tree with its given
-//grammar, these following functions represent the different type of nodes that
-//exist within the UM language. As we walk down a tree, we process the nodes
-//type bases on its opcode instruction.
-static inline void cond_move(uint32_t* registers, unsigned a, unsigned b, unsigned c);
-static inline void seg_store(uint32_t* registers, unsigned a, unsigned b, unsigned c, Memseg_T prog);
-static inline void seg_load(uint32_t* registers, unsigned a, unsigned b, unsigned c, Memseg_T prog);
-static inline void add(uint32_t* registers, unsigned a, unsigned b, unsigned c);
-static inline void mult(uint32_t* registers, unsigned a, unsigned b, unsigned c);
-static inline void divide(uint32_t* registers, unsigned a, unsigned b, unsigned c);
-static inline void nand(uint32_t* registers, unsigned a, unsigned b, unsigned c);
-static inline void map_seg(uint32_t* registers, unsigned b, unsigned c, Memseg_T prog);
-static inline void unmap_seg(uint32_t* registers, unsigned c, Memseg_T prog);
-static inline void output(uint32_t* registers, unsigned c);
-static inline void input(uint32_t* registers, unsigned c);
-static inline void load_prog(uint32_t* registers, unsigned b, unsigned c, Memseg_T prog, unsigned *idx);
-static inline void load_value(uint32_t* registers, unsigned a,uint32_t x);
-static inline void halt(Memseg_T program);
+//The engines that execute one word at a time all share interp_word, which has to be
+//inlined into each of them to keep its switch off the call path
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE inline
+#endif
+static ALWAYS_INLINE int interp_word(Codeword word, unsigned *registers, Memseg_T program, Umio_T io, unsigned * idx,
+                                     Interp_status *status);
+static inline Codeword fetch(Codeword *code, Memseg_T program, uint32_t ctr);
+static void report_sequences(uint64_t pairs[16][16], uint64_t triples[16][16][16], uint64_t total);
 /************************************************************************************/
 //Interp_prog includes the main cycle in which UM interpretation is conducted.
 //This fuction takes in a memory segment populated with a program and a pointer
-//to an array representing registers and interprets that passed in program.
-extern void Interp_prog(Memseg_T program, unsigned *registers){
+//to an array representing registers and interprets that passed in program,
+//returning once it halts. Input and output go through 'io'.
+extern Interp_status Interp_prog(Memseg_T program, unsigned *registers, uint32_t *pc, Umio_T io){
 
-    uint32_t word = 0;//instruction word
+    uint32_t length;  //length of segment 0
+    Codeword *code = Memseg_code(program, &length);//Unpacked words
     Codeword codeword;//Unpacked word
-    unsigned ctr = 0; //program instruction counter
+    unsigned ctr = *pc; //program instruction counter
+    Interp_status status; //why the machine stopped
 
     //Interpret the program
     while(1){
-        word = Memseg_load(program,0,ctr);
-        codeword = get_codeword(word,codeword);
-        interp_word(codeword,registers,program, &ctr);
+        if (ctr >= length){
+            *pc = ctr;
+            return INTERP_FAULTED;
+        }
+        codeword = fetch(code, program, ctr);
+        if (!interp_word(codeword,registers,program,io, &ctr, &status)){
+            *pc = ctr;
+            return status;
+        }
         ++ctr;
+
+        //A load program may have replaced segment 0
+        if (codeword.opcode == 12){
+            code = Memseg_code(program, &length);
+        }
     }
 }
 /************************************************************************************/
-//Function get_codeword takes in a 32 bit word and a codeword struct and then
-//populates the structs members with the values found within the passed in word.
-//This function will determine what type of operation was called and which
-//values need to be retrieved as a result of the call.
-static Codeword get_codeword(uint32_t word, Codeword codeword){
+//Interp_prog_sequences interprets the program like Interp_prog while counting how often
+//each pair and triple of opcodes runs back to back in straight-line code, and reports
+//the most frequent ones on stderr when the program halts. The report is what
+//FUSE_SEQUENCES in um_fuse.h is chosen from. A store, halt or load program ends a run,
+//since Decode_fuse never continues a superinstruction past one.
+extern Interp_status Interp_prog_sequences(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                          Umio_T io){
 
-    unsigned opcode = Bitpack_getu(word, 4, 28);
+    static uint64_t pairs[16][16];      //executions of each opcode pair
+    static uint64_t triples[16][16][16];//executions of each opcode triple
+    uint64_t total = 0;                 //instructions executed
+    int before = -1, last = -1;         //opcodes of the run so far, -1 if none
 
-    //Determine if we have a 3 or 2 register instruction and then assemble the
-    //designated codeword
-    if (opcode == 13){
-        codeword.opcode = opcode;
-        codeword.a = Bitpack_getu(word, 3, 25);
-        codeword.b = Bitpack_getu(word, 25, 0);
+    uint32_t length;
+    Codeword *code = Memseg_code(program, &length);
+    Codeword codeword;
+    unsigned ctr = *pc;
+    Interp_status status = INTERP_HALTED;
+
+    while(1){
+        if (ctr >= length){
+            status = INTERP_FAULTED;
+            break;
+        }
+        codeword = fetch(code, program, ctr);
+        int op = codeword.opcode;
+        ++total;
+        if (last >= 0){
+            ++pairs[last][op];
+        }
+        if (before >= 0){
+            ++triples[before][last][op];
+        }
+        if (op == 2 || op == 7 || op == 12 || op > 13){
+            before = last = -1;
+        }
+        else{
+            before = last;
+            last = op;
+        }
+
+        if (!interp_word(codeword,registers,program,io, &ctr, &status)){
+            break;
+        }
+        ++ctr;
+        if (codeword.opcode == 12){
+            code = Memseg_code(program, &length);
+            before = last = -1;
+        }
     }
-    else{
-        codeword.opcode = opcode;
-        codeword.a = Bitpack_getu(word, 3, 6);
-        codeword.b = Bitpack_getu(word, 3, 3);
-        codeword.c = Bitpack_getu(word, 3, 0);
+    *pc = ctr;
+    report_sequences(pairs, triples, total);
+    return status;
+}
+/************************************************************************************/
+//Interp_prog_counts interprets the program like Interp_prog while counting the
+//executions of each opcode and each segment 0 PC, and the load programs along with the
+//words they bring into segment 0, into 'profile'. The counting lives only in this
+//engine, so the others run as before.
+extern Interp_status Interp_prog_counts(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                       Umio_T io, Profile *profile){
+
+    uint32_t length;
+    Codeword *code = Memseg_code(program, &length);
+    Codeword codeword;
+    unsigned ctr = *pc;
+    Interp_status status;
+
+    Profile_grow(profile, length);
+    while(1){
+        if (ctr >= length){
+            *pc = ctr;
+            return INTERP_FAULTED;
+        }
+        codeword = fetch(code, program, ctr);
+        ++profile->opcodes[codeword.opcode];
+        ++profile->pcs[ctr];
+        if (codeword.opcode == 12){
+            ++profile->loads;
+            if (registers[codeword.b] != 0){
+                uint32_t words;
+                Memseg_segment(program, registers[codeword.b], &words);
+                ++profile->farLoads;
+                profile->wordsLoaded += words;
+            }
+        }
+
+        if (!interp_word(codeword,registers,program,io, &ctr, &status)){
+            *pc = ctr;
+            return status;
+        }
+        ++ctr;
+        if (codeword.opcode == 12){
+            code = Memseg_code(program, &length);
+            Profile_grow(profile, length);
+        }
     }
+}
+/************************************************************************************/
+//Interp_prog_profile runs Interp_prog_counts and writes the report on stderr when the
+//program halts
+extern Interp_status Interp_prog_profile(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                        Umio_T io){
+    Profile profile;
+    Profile_init(&profile, 0);
+    Interp_status status = Interp_prog_counts(program, registers, pc, io, &profile);
+    Profile_report(&profile, program, stderr);
+    Profile_free(&profile);
+    return status;
+}
+/************************************************************************************/
+//Interp_prog_traced interprets the program like Interp_prog while recording it in
+//'trace'. An unmap, store or load program is recorded before it runs, from the
+//registers that name its target, and a map after, once it has its ID. The recording
+//lives only in this engine, so the others run as before.
+extern Interp_status Interp_prog_traced(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                        Umio_T io, Trace *trace){
 
-    return codeword;
+    uint32_t length;
+    Codeword *code = Memseg_code(program, &length);
+    Codeword codeword;
+    unsigned ctr = *pc;
+    Interp_status status;
+
+    while(1){
+        if (ctr >= length){
+            *pc = ctr;
+            return INTERP_FAULTED;
+        }
+        if (Trace_requested){
+            Trace_requested = 0;
+            Trace_write(trace, INTERP_STOPPED, ctr);
+        }
+        codeword = fetch(code, program, ctr);
+        Trace_step(trace, ctr, codeword.opcode);
+
+        uint32_t size = registers[codeword.c];
+        switch (codeword.opcode){
+            case 2:
+                if (registers[codeword.a] == 0){
+                    Trace_event(trace, TRACE_STORE, registers[codeword.b]);
+                }
+                break;
+            case 9:
+                Trace_event(trace, TRACE_UNMAP, registers[codeword.c]);
+                break;
+            case 12:
+                if (registers[codeword.b] != 0){
+                    Trace_event(trace, TRACE_LOAD, registers[codeword.b]);
+                }
+                break;
+        }
+
+        if (!interp_word(codeword,registers,program,io, &ctr, &status)){
+            *pc = ctr;
+            return status;
+        }
+        ++ctr;
+        if (codeword.opcode == 8){
+            Trace_event(trace, TRACE_MAP, registers[codeword.b]);
+            Trace_varint(trace, size);
+        }
+        if (codeword.opcode == 12){
+            code = Memseg_code(program, &length);
+        }
+    }
 }
 /************************************************************************************/
-//Function interp_word determines what the operation code of the passed in codeword is
-//and then passes control into the corresponding function which will correctly interpret
-//the individual words instruction.
-static void interp_word(Codeword word, unsigned *registers, Memseg_T program, unsigned * idx){
+//Interp_prog_clocked interprets the program like Interp_prog while counting the
+//instructions it runs on from '*clock'. The count is kept in a local and only stored
+//to '*clock' ahead of an input instruction, which is when 'io' reads it, and on return.
+extern Interp_status Interp_prog_clocked(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                         Umio_T io, uint64_t *clock){
 
-    //INSTRUCTION SWITCH                                        INSTRUCTION:
-    switch(word.opcode){
-        case 0:                                                 //CONDITIONAL MOVE
-            cond_move(registers,word.a,word.b,word.c);
-            break;
-        case 1:                                                 //SEGMENTED LOAD
-            seg_load(registers,word.a,word.b,word.c,program);
-            break;
-        case 2:                                                 //SEGMENTED STORE
-            seg_store(registers, word.a,word.b,word.c,program);
-            break;
-        case 3:                                                 //ADDITION
-            add(registers,word.a,word.b,word.c);
-            break;
-        case 4:                                                 //MULTIPLICATION
-            mult(registers,word.a,word.b,word.c);
-            break;
-        case 5:                                                 //DIVISION
-            divide(registers,word.a,word.b,word.c);
-            break;
-        case 6:                                                 //BITWISE NAND
-            nand(registers,word.a,word.b,word.c);
-            break;
-        case 7:                                                 //HALT
-            halt(program);
-            break;
-        case 8:                                                 //MAP SEGMENT
-            map_seg(registers, word.b, word.c, program);
-            break;
-        case 9:                                                 //UNMAP SEGMENT
-            unmap_seg(registers, word.c, program);
-            break;
-        case 10:                                                //IO OUTPUT
-            output(registers, word.c);
-            break;
-        case 11:                                                //IO INPUT
-            input(registers, word.c);
-            break;
-        case 12:                                                //LOAD PROGRAM
-            load_prog(registers,word.b,word.c,program,idx);
-            break;
-        case 13:                                                //LOAD VALUE
-            load_value(registers, word.a, (uint32_t)word.b);
-            break;           
+    uint32_t length;
+    Codeword *code = Memseg_code(program, &length);
+    Codeword codeword;
+    unsigned ctr = *pc;
+    Interp_status status;
+    uint64_t count = *clock;
+
+    for (; ; ++count){
+        if (ctr >= length){
+            *pc = ctr;
+            *clock = count;
+            return INTERP_FAULTED;
+        }
+        codeword = fetch(code, program, ctr);
+        if (codeword.opcode == 11){
+            *clock = count;
+        }
+        if (!interp_word(codeword,registers,program,io, &ctr, &status)){
+            *pc = ctr;
+            *clock = count + (status == INTERP_HALTED);
+            return status;
+        }
+        ++ctr;
+        if (codeword.opcode == 12){
+            code = Memseg_code(program, &length);
+        }
     }
 }
-/********************************************************************************************/
-//Function cond_move interprets a conditional move instruction in the universal machine
-static inline void cond_move(uint32_t *registers, unsigned a, unsigned b, unsigned c){
-    if (registers[c] != 0){
-        registers[a] = registers[b];
+/************************************************************************************/
+//Interp_prog_until interprets the program like Interp_prog from '*pc', but checks before
+//each instruction whether it should stop there: once 'limit' instructions have run, at
+//the first input instruction if 'atInput' is set, or once '*stop' is set. It leaves the
+//machine so that any engine started at '*pc' carries on as if it had never stopped, and
+//takes any footprint sample that falls due on the way.
+extern Interp_status Interp_prog_until(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                      Umio_T io, uint64_t limit, int atInput,
+                                      volatile sig_atomic_t *stop){
+
+    uint32_t length;
+    Codeword *code = Memseg_code(program, &length);
+    Codeword codeword;
+    unsigned ctr = *pc;
+    Interp_status status;
+
+    for (uint64_t done = 0; ; ++done){
+        if (ctr >= length){
+            *pc = ctr;
+            return INTERP_FAULTED;
+        }
+        if (Footprint_due){
+            Memseg_footprint(program);
+        }
+        codeword = fetch(code, program, ctr);
+        if (done >= limit || (atInput && codeword.opcode == 11) || *stop){
+            *pc = ctr;
+            return INTERP_STOPPED;
+        }
+        if (!interp_word(codeword,registers,program,io, &ctr, &status)){
+            *pc = ctr;
+            return status;
+        }
+        ++ctr;
+        if (codeword.opcode == 12){
+            code = Memseg_code(program, &length);
+        }
     }
 }
-/********************************************************************************************/
-//Function seg_load interprets a segmented load instruction in the universal machine
-static inline void seg_load(uint32_t *registers, unsigned a, unsigned b, unsigned c, Memseg_T prog){
-    registers[a] = Memseg_load(prog, registers[b],registers[c]);
+/************************************************************************************/
+//Interp_prog_checked interprets the program one word at a time like Interp_prog, but
+//expands the check UM_OPCODES names for each opcode ahead of its body. A failed check
+//returns its fault with the PC still on the instruction, which has not run.
+extern Interp_status Interp_prog_checked(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                         Umio_T io){
+
+    uint32_t length;
+    Codeword *code = Memseg_code(program, &length);
+    Codeword word;
+    unsigned ctr = *pc;
+    uint32_t words;   //length of the segment an instruction names
+
+#define FAULT(status) do { *pc = ctr; return (status); } while (0)
+#define CHECK_WORD(segment, offset) do {                     \
+        if (!Memseg_mapped(program, (segment), &words))     \
+            FAULT(INTERP_UNMAPPED);                         \
+        if ((offset) >= words)                              \
+            FAULT(INTERP_BOUNDS);                           \
+    } while (0)
+#define CHECK_NONE(r, w)    ((void)0)
+#define CHECK_READ(r, w)    CHECK_WORD(r[w.b], r[w.c])
+#define CHECK_WRITE(r, w)   CHECK_WORD(r[w.a], r[w.b])
+#define CHECK_DIVIDE(r, w)  do { if (r[w.c] == 0) FAULT(INTERP_DIVIDE); } while (0)
+#define CHECK_UNMAP(r, w)   do {                             \
+        if (r[w.c] == 0 || !Memseg_mapped(program, r[w.c], &words)) \
+            FAULT(INTERP_UNMAPPED);                         \
+    } while (0)
+#define CHECK_OUTPUT(r, w)  do { if (r[w.c] > 255) FAULT(INTERP_OUTPUT); } while (0)
+#define CHECK_PROGRAM(r, w) do {                             \
+        if (!Memseg_mapped(program, r[w.b], &words))        \
+            FAULT(INTERP_UNMAPPED);                         \
+    } while (0)
+#define CHECK_OPCODE(r, w)  FAULT(INTERP_OPCODE)
+
+#define UM_HALT() FAULT(INTERP_HALTED)
+#define UM_FAULT(fault) FAULT(fault)
+#define UM_LOAD_PROGRAM(segment, counter) do {               \
+        if ((segment) != 0){                                \
+            if (!Memseg_load_prog(program, (segment)))      \
+                UM_FAULT(INTERP_MEMORY);                    \
+            code = Memseg_code(program, &length);           \
+        }                                                   \
+        ctr = (counter) - 1;                                \
+    } while (0)
+#define CASE(n, name, check)                                \
+    case n:                                                 \
+        CHECK_##check(registers, word);                     \
+        UM_OP_##n(registers, word);                         \
+        break;
+
+    while(1){
+        if (ctr >= length){
+            FAULT(INTERP_FAULTED);
+        }
+        word = fetch(code, program, ctr);
+        switch (word.opcode){
+            UM_OPCODES(CASE)
+        }
+        ++ctr;
+    }
+
+#undef CASE
+#undef UM_HALT
+#undef UM_FAULT
+#undef UM_LOAD_PROGRAM
+#undef CHECK_WORD
+#undef CHECK_NONE
+#undef CHECK_READ
+#undef CHECK_WRITE
+#undef CHECK_DIVIDE
+#undef CHECK_UNMAP
+#undef CHECK_OUTPUT
+#undef CHECK_PROGRAM
+#undef CHECK_OPCODE
+#undef FAULT
 }
-/********************************************************************************************/
-//Function seg_store interprets a segmented store instruction in the universal machine
-static inline void seg_store(uint32_t *registers, unsigned a, unsigned b, unsigned c, Memseg_T prog){
-    Memseg_store(prog, registers[c], registers[a], registers[b]);
+/************************************************************************************/
+//Interp_fault names each fault the way um reports it
+extern const char *Interp_fault(Interp_status status){
+    switch (status){
+        case INTERP_FAULTED:  return "program counter outside of segment 0";
+        case INTERP_UNMAPPED: return "unmapped segment, or unmap of segment 0";
+        case INTERP_BOUNDS:   return "offset outside of segment";
+        case INTERP_DIVIDE:   return "division by zero";
+        case INTERP_OUTPUT:   return "output value above 255";
+        case INTERP_OPCODE:   return "invalid opcode";
+        case INTERP_MEMORY:   return "out of memory for a segment";
+        default:              return "no fault";
+    }
 }
-/********************************************************************************************/
-//Function add interprets an addition instruction in the universal machine
-static inline void add(uint32_t *registers,unsigned a,unsigned b, unsigned c){
-    registers[a] = registers[b] + registers[c];
+/************************************************************************************/
+//Interp_prog_threaded is the direct-threaded counterpart of Interp_prog. Each handler
+//ends by fetching the next predecoded word from the cached segment 0 code pointer and
+//jumping through the dispatch table on its opcode, so there is no central switch and
+//no call into the bitpack module. The registers live in a local array for the duration
+//of the run. The cached code pointer and length are only refreshed by load_prog, which
+//is the only instruction that can replace segment 0; stores into segment 0 update the
+//predecoded words in place by marking them stale.
+//
+//Every superinstruction in FUSE_SEQUENCES gets a handler of its own that runs the body
+//of each of its instructions in turn, taking the registers of the later ones from the
+//words after it, and dispatches once at the end.
+//
+//Interp_prog_watched runs the same code with 'watched' set, which sends every load
+//program through the watch label once it has run. That is the one instruction every
+//loop in a UM program runs, so a flag raised by a signal is seen soon after, at the
+//cost of one branch per load program in the plain engine. Label addresses cannot be
+//copied into an inlined function, so the flag is tested at run time.
+
+//dispatches superinstructions took the place of, added to atomically since machines
+//may run on several threads at once
+static uint64_t dispatchesSaved;
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" //label addresses are a GNU extension
+static Interp_status threaded(Memseg_T program, unsigned *registers, uint32_t *pc, Umio_T io,
+                              int watched, int sample, volatile sig_atomic_t *stop){
+
+#define LABEL(n, name, check)  &&op_##name,
+#define FUSED_LABEL2(x, y)    &&fused_##x##_##y,
+#define FUSED_LABEL3(x, y, z) &&fused_##x##_##y##_##z,
+    static void *const dispatch[] = {
+        UM_OPCODES(LABEL)
+        &&op_stale,
+        FUSE_SEQUENCES(FUSED_LABEL2, FUSED_LABEL3)
+    };
+#undef LABEL
+#undef FUSED_LABEL2
+#undef FUSED_LABEL3
+
+    uint32_t r[8];     //registers held locally for the run
+    uint32_t length;   //length of segment 0
+    Codeword *code = Memseg_code(program, &length);
+    uint32_t ctr = *pc;//program instruction counter
+    Codeword word;     //unpacked instruction word
+    uint64_t saved = 0;//dispatches saved by superinstructions
+    Interp_status status;
+    uint32_t history[SAMPLE_DEPTH];//targets of the latest load programs
+    uint64_t loads = 0;            //load programs so far, when watched
+    uint32_t from = 0;             //PC of the load program just run
+
+    for (int i = 0; i < 8; ++i){
+        r[i] = registers[i];
+    }
+
+#define DISPATCH() do {                                  \
+        if (ctr >= length) goto out_of_bounds;          \
+        word = code[ctr++];                             \
+        goto *dispatch[word.opcode];                    \
+    } while (0)
+
+#define UM_HALT() do {                                  \
+        *pc = ctr - 1;                                  \
+        status = INTERP_HALTED;                         \
+        goto finish;                                    \
+    } while (0)
+#define UM_FAULT(fault) do {                            \
+        *pc = ctr - 1;                                  \
+        status = (fault);                               \
+        goto finish;                                    \
+    } while (0)
+#define UM_LOAD_PROGRAM(segment, counter) do {           \
+        /*Only a jump to another segment replaces segment 0*/ \
+        if ((segment) != 0){                            \
+            if (!Memseg_load_prog(program, (segment)))  \
+                UM_FAULT(INTERP_MEMORY);                \
+            code = Memseg_code(program, &length);       \
+        }                                               \
+        if (watched){                                   \
+            from = ctr - 1;                             \
+            ctr = (counter);                            \
+            goto watch;                                 \
+        }                                               \
+        ctr = (counter);                                \
+    } while (0)
+
+    DISPATCH();
+
+    //One handler per opcode, each running the body UM_OPCODES gives it
+#define HANDLER(n, name, check)                         \
+op_##name:                                              \
+    UM_OP_##n(r, word);                                 \
+    DISPATCH();
+    UM_OPCODES(HANDLER)
+#undef HANDLER
+
+op_stale:
+    //The word was overwritten since it was decoded
+    word = Decode_word(Memseg_load(program, 0, ctr - 1));
+    code[ctr - 1] = word;
+    goto *dispatch[word.opcode];
+
+    //Superinstructions. Decode_fuse only fuses words that fit in segment 0, and only a
+    //store, halt or load program, which come last, can change what follows.
+#define FUSED_HANDLER2(x, y)                            \
+fused_##x##_##y:                                        \
+    UM_OP_##x(r, word);                                 \
+    word = code[ctr++];                                 \
+    ++saved;                                            \
+    UM_OP_##y(r, word);                                 \
+    DISPATCH();
+#define FUSED_HANDLER3(x, y, z)                         \
+fused_##x##_##y##_##z:                                  \
+    UM_OP_##x(r, word);                                 \
+    word = code[ctr++];                                 \
+    UM_OP_##y(r, word);                                 \
+    word = code[ctr++];                                 \
+    saved += 2;                                         \
+    UM_OP_##z(r, word);                                 \
+    DISPATCH();
+    FUSE_SEQUENCES(FUSED_HANDLER2, FUSED_HANDLER3)
+#undef FUSED_HANDLER2
+#undef FUSED_HANDLER3
+
+watch:
+    //A sample is charged to the load program, below the targets that led to it
+    if (sample && Sample_due){
+        Sample_take(from, history, loads);
+    }
+    history[loads++ % SAMPLE_DEPTH] = ctr;
+    if (Footprint_due){
+        Memseg_footprint(program);
+    }
+    if (stop != NULL && *stop){
+        *pc = ctr;
+        status = INTERP_STOPPED;
+        goto finish;
+    }
+    DISPATCH();
+
+out_of_bounds:
+    *pc = ctr;
+    status = INTERP_FAULTED;
+finish:
+    for (int i = 0; i < 8; ++i){
+        registers[i] = r[i];
+    }
+    __atomic_fetch_add(&dispatchesSaved, saved, __ATOMIC_RELAXED);
+    return status;
+#undef DISPATCH
+#undef UM_HALT
+#undef UM_FAULT
+#undef UM_LOAD_PROGRAM
 }
-/********************************************************************************************/
-//Function multi interprets a multiplication instruction in the universal machine
-static inline void mult(uint32_t *registers,unsigned a,unsigned b, unsigned c){
-    registers[a] = registers[b] * registers[c];
+#pragma GCC diagnostic pop
+
+extern Interp_status Interp_prog_threaded(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                         Umio_T io){
+    return threaded(program, registers, pc, io, 0, 0, NULL);
 }
-/********************************************************************************************/
-//Function divide interprets a division instruction in the universal machine
-static inline void divide(uint32_t *registers,unsigned a,unsigned b, unsigned c){
-    registers[a] = registers[b] / registers[c];
+
+extern Interp_status Interp_prog_watched(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                        Umio_T io, int sample, volatile sig_atomic_t *stop){
+    return threaded(program, registers, pc, io, 1, sample, stop);
 }
-/********************************************************************************************/
-//Function nand interprets a bitwase NAND instruction in the universal machine
-static inline void nand(uint32_t *registers,unsigned a,unsigned b, unsigned c){
-    registers[a] = ~(registers[b] & registers[c]);
+#else
+extern Interp_status Interp_prog_threaded(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                         Umio_T io){
+    return Interp_prog(program, registers, pc, io);
 }
-/********************************************************************************************/
-//Function halt interprets a halt instruction in the universal machine
-static inline void halt(Memseg_T program){
-    Memseg_free(program);
-    exit(0);
+
+extern Interp_status Interp_prog_watched(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                        Umio_T io, int sample, volatile sig_atomic_t *stop){
+    static volatile sig_atomic_t never = 0;
+    (void)sample;
+    return Interp_prog_until(program, registers, pc, io, UINT64_MAX, 0,
+                             stop != NULL ? stop : &never);
 }
-/********************************************************************************************/
-//Function map_seg interprets a map segment instruction in the universal machine
-static inline void map_seg(uint32_t *registers, unsigned b, unsigned c, Memseg_T program){
-    unsigned location = Memseg_map(program, registers[c]);
-    registers[b] = location;
+#endif
+/************************************************************************************/
+//Interp_dispatches_saved returns how many dispatches superinstructions have taken the
+//place of in every run of Interp_prog_threaded so far
+extern uint64_t Interp_dispatches_saved(void){
+#if defined(__GNUC__)
+    return __atomic_load_n(&dispatchesSaved, __ATOMIC_RELAXED);
+#else
+    return dispatchesSaved;
+#endif
 }
-/********************************************************************************************/
-//Function unmap_seg interprets a unmap segment instruction in the universal machine
-static inline void unmap_seg(uint32_t *registers, unsigned c, Memseg_T program){
-    Memseg_unmap(program, registers[c]);
+/************************************************************************************/
+//Function interp_word runs the passed in codeword through the body UM_OPCODES gives its
+//opcode, with no checks. It returns 1 if the machine carries on, and otherwise 0 with
+//'status' set to why it stopped: a halt, or the fault of a map, store, unmap or load
+//program that could not be made. A load
+//program leaves 'idx' one short of its target, for the caller to step onto it.
+static ALWAYS_INLINE int interp_word(Codeword word, unsigned *registers, Memseg_T program, Umio_T io, unsigned * idx,
+                                     Interp_status *status){
+
+#define UM_HALT() do { *status = INTERP_HALTED; return 0; } while (0)
+#define UM_FAULT(fault) do { *status = (fault); return 0; } while (0)
+#define UM_LOAD_PROGRAM(segment, counter) do {               \
+        if ((segment) != 0){                                \
+            if (!Memseg_load_prog(program, (segment)))      \
+                UM_FAULT(INTERP_MEMORY);                    \
+        }                                                   \
+        *idx = (counter) - 1;                               \
+    } while (0)
+#define CASE(n, name, check) case n: UM_OP_##n(registers, word); break;
+
+    switch(word.opcode){
+        UM_OPCODES(CASE)
+    }
+    return 1;
+
+#undef CASE
+#undef UM_HALT
+#undef UM_FAULT
+#undef UM_LOAD_PROGRAM
 }
 /********************************************************************************************/
-//Function ouput interprets an IO output instruction in the universal machine
-static inline void output(uint32_t *registers, unsigned c){
-    printf("%c", registers[c]);
+//Function fetch returns the predecoded word at 'ctr' for engines that execute one word at
+//a time, decoding it again if it went stale and reducing a superinstruction to its first
+//instruction.
+static inline Codeword fetch(Codeword *code, Memseg_T program, uint32_t ctr){
+    Codeword codeword = code[ctr];
+    codeword.opcode = Decode_heads[codeword.opcode];
+    if (codeword.opcode == DECODE_STALE){
+        codeword = Decode_word(Memseg_load(program, 0, ctr));
+        code[ctr] = codeword;
+    }
+    return codeword;
 }
 /********************************************************************************************/
-//Function input interprets an IO input instruction in the universal machine 
-static inline void input(uint32_t *registers, unsigned c){
-    registers[c] = getc(stdin);
+//A Sequence is one line of the report of Interp_prog_sequences
+typedef struct Sequence {
+    uint64_t count;
+    int length;
+    int ops[3];
+} Sequence;
+
+//Function by_count orders Sequences from most to least executed
+static int by_count(const void *x, const void *y){
+    const Sequence *a = x, *b = y;
+    return (a->count < b->count) - (a->count > b->count);
 }
-/********************************************************************************************/
-//Function load_prog interprets a load program instruction in the universal machine
-static inline void load_prog(uint32_t *registers, unsigned b, unsigned c, Memseg_T program, unsigned * idx){
-    if (registers[b] != 0){
-        Memseg_load_prog(program, registers[b]);
+//Function report_sequences prints the most frequent triples and pairs that may be fused,
+//in the form FUSE_SEQUENCES takes them, with their counts
+static void report_sequences(uint64_t pairs[16][16], uint64_t triples[16][16][16], uint64_t total){
+    enum { SHOWN = 12 };
+    static Sequence found[16 * 16 * 16];
+    const char *names[] = { "TRIPLE", "PAIR" };
+
+    fprintf(stderr, "instructions executed: %" PRIu64 "\n", total);
+    for (int pass = 0; pass < 2; ++pass){
+        int n = 0;
+        for (int x = 0; x < 14; ++x){
+            for (int y = 0; y < 14; ++y){
+                for (int z = 0; z < (pass == 0 ? 14 : 1); ++z){
+                    uint64_t count = pass == 0 ? triples[x][y][z] : pairs[x][y];
+                    if (count != 0){
+                        Sequence seq = { count, 3 - pass, { x, y, z } };
+                        found[n++] = seq;
+                    }
+                }
+            }
+        }
+        qsort(found, n, sizeof(Sequence), by_count);
+        for (int i = 0; i < n && i < SHOWN; ++i){
+            fprintf(stderr, "    %s(%d, %d", names[pass], found[i].ops[0], found[i].ops[1]);
+            if (found[i].length == 3){
+                fprintf(stderr, ", %d", found[i].ops[2]);
+            }
+            fprintf(stderr, ") /* %" PRIu64 ", %.1f%% */\n", found[i].count,
+                    100.0 * found[i].count / total);
+        }
     }
-    //Set the program counter index
-    *idx = registers[c] - 1;
 }
 /********************************************************************************************/
-//Function load_value interprets a load value instruction in the universal machine
-static inline void load_value(uint32_t *registers, unsigned a, uint32_t x){
-    registers[a] = x;
-}
\ No newline at end of file
@@ -2,12 +2,134 @@
 //Universal Machine interpreter interface
 
 /*****************************************************************/
+#ifndef INTERP_INCLUDED
+#define INTERP_INCLUDED
 #include"um_mem.h"
+#include"um_io.h"
+#include"um_profile.h"
+#include"um_trace.h"
+#include<signal.h>
 /*****************************************************************/
-extern void Interp_prog(Memseg_T program, unsigned *registers);
+//An Interp_status tells how an engine stopped. INTERP_HALTED is
+//a halt instruction, and INTERP_STOPPED is only returned by
+//Interp_prog_until and Interp_prog_watched. Every status from
+//INTERP_FAULTED on is a fault. Every engine reports
+//INTERP_FAULTED, a program counter outside of segment 0,
+//INTERP_MEMORY, a map, store or load program the host has no
+//memory for, and INTERP_UNMAPPED for an unmap of segment 0 or
+//of one that is not mapped; the others are only found by
+//Interp_prog_checked.
+//In every case '*pc' is left at the offending word, which has
+//not run, and the registers hold their values at that point.
+//No engine exits the process or prints anything for a fault,
+//which is left to the caller.
+typedef enum Interp_status {
+    INTERP_HALTED, INTERP_STOPPED,
+    INTERP_FAULTED,  //program counter outside of segment 0
+    INTERP_UNMAPPED, //access to an unmapped segment, or unmap of one
+    INTERP_BOUNDS,   //offset outside of its segment
+    INTERP_DIVIDE,   //division by zero
+    INTERP_OUTPUT,   //output of a value above 255
+    INTERP_OPCODE,   //opcode 14 or 15
+    INTERP_MEMORY    //map, copy or decode the host has no memory for
+} Interp_status;
+/*****************************************************************/
+extern Interp_status Interp_prog(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                Umio_T io);
 //Function Interpret_prog acts as the main interpretation driver
 //for a universal machine program. This function takes in a 
 //Memseg_t representing the program in memory and a pointer
 //to a integer array representing the machines registers
-//and then interprets the passed in universal machine program.
-/*****************************************************************/
\ No newline at end of file
+//and then interprets the passed in universal machine program,
+//starting at word '*pc' of segment 0: 0 for a freshly loaded
+//program, or the PC of a restored snapshot. Every engine below
+//takes 'pc' the same way.
+//It returns when the program halts or faults, leaving 'program'
+//for the caller to free. The input and output instructions go through
+//'io', whose output the caller flushes by freeing it.
+extern Interp_status Interp_prog_threaded(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                          Umio_T io);
+//Function Interp_prog_threaded interprets the same programs as
+//Interp_prog, but dispatches each instruction straight to its
+//handler with a computed goto, reading the predecoded words
+//through a cached pointer to segment 0. Compilers without label
+//addresses fall back to Interp_prog.
+extern Interp_status Interp_prog_watched(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                         Umio_T io, int sample, volatile sig_atomic_t *stop);
+//Function Interp_prog_watched interprets the same programs as
+//Interp_prog_threaded, but looks up after every load program,
+//which every loop runs. If 'sample' is set it takes a sample
+//whenever Sample_due is, charged to that load program with the
+//targets of those before it. It takes a footprint sample there
+//whenever Footprint_due is set, so one asked for by a program
+//that maps nothing is not put off. Once '*stop' is set, unless
+//'stop' is NULL, it returns INTERP_STOPPED with '*pc' on the
+//target, which has not run. Compilers without label addresses
+//fall back to Interp_prog_until, which takes no samples.
+extern Interp_status Interp_prog_checked(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                        Umio_T io);
+//Function Interp_prog_checked interprets the same programs as
+//Interp_prog, but checks every instruction against the fault the
+//UM specification allows it, as UM_OPCODES in um_ops.h lists them,
+//before running it, and returns that fault instead of running on.
+extern const char *Interp_fault(Interp_status status);
+//Function Interp_fault describes the fault 'status' in words
+extern uint64_t Interp_dispatches_saved(void);
+//Function Interp_dispatches_saved returns the number of dispatches
+//Interp_prog_threaded has saved so far by running superinstructions,
+//which count one for each word they execute past their first.
+extern Interp_status Interp_prog_sequences(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                           Umio_T io);
+//Function Interp_prog_sequences interprets the same programs as
+//Interp_prog, and on halt reports on stderr the pairs and triples
+//of opcodes run back to back most often, which is the profile
+//FUSE_SEQUENCES in um_fuse.h is chosen from.
+extern Interp_status Interp_prog_counts(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                       Umio_T io, Profile *profile);
+//Function Interp_prog_counts interprets the same programs as
+//Interp_prog, adding the executions by opcode and by segment 0 PC
+//and the load programs to 'profile', which the caller set up with
+//Profile_init.
+extern Interp_status Interp_prog_profile(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                         Umio_T io);
+//Function Interp_prog_profile interprets the same programs as
+//Interp_prog, counting executions by opcode and by segment 0 PC
+//and the load programs, and on halt writes the report of
+//Profile_report on stderr.
+extern Interp_status Interp_prog_traced(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                        Umio_T io, Trace *trace);
+//Function Interp_prog_traced interprets the same programs as
+//Interp_prog, recording each instruction and each map, unmap,
+//store into segment 0 and load program from another segment in
+//'trace', which the caller set up with Trace_init. It writes the
+//trace whenever Trace_requested is set, and leaves writing it at
+//the end to the caller. Recording costs about 4 ns an instruction
+//over Interp_prog, so a traced run takes about twice as long as
+//one under Interp_prog_threaded.
+extern Interp_status Interp_prog_clocked(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                         Umio_T io, uint64_t *clock);
+//Function Interp_prog_clocked interprets the same programs as
+//Interp_prog, adding the instructions it runs to '*clock'. Each
+//input instruction finds in '*clock' the number of instructions
+//run before it, which is what Umio_record logs and Umio_replay
+//checks.
+extern Interp_status Interp_prog_until(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                      Umio_T io, uint64_t limit, int atInput,
+                                      volatile sig_atomic_t *stop);
+//Function Interp_prog_until interprets the same programs as
+//Interp_prog from '*pc', stopping before the instruction that
+//would come after 'limit' instructions, before the first input
+//instruction when 'atInput' is set, or before the next one once
+//'*stop' is set. It returns INTERP_STOPPED with the PC of that
+//instruction in '*pc', unless the program halted or faulted
+//first.
+extern Interp_status Interp_prog_jit(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                     Umio_T io);
+//Function Interp_prog_jit interprets the same programs as
+//Interp_prog by translating segment 0 into x86-64 machine code
+//block by block as it is reached. Stores into translated words
+//drop the affected blocks, and a load program from another
+//segment drops them all. Other machines fall back to
+//Interp_prog_threaded.
+/*****************************************************************/
+#endif
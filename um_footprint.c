@@ -0,0 +1,180 @@
+//Timothy Colaneri
+//Universal Machine memory footprint implementation
+
+/* The real time timer (ITIMER_REAL) and FOOTPRINT_SIGNAL only set
+Footprint_due; the memory space notices it at its next map, unmap or
+load program, or the engine at its next look, and calls
+Footprint_take, which copies the counters outside of the signal
+handler. A program that maps nothing for a while has the same
+footprint all that time, so nothing is lost by waiting for the next
+map, but a write FOOTPRINT_SIGNAL asked for cannot wait on one, which
+is why um runs the engines that look for it.
+The samples are kept in memory and written whole, through a file that
+is renamed into place, so the file always holds a complete series. */
+
+/**********************************************************************/
+#define _XOPEN_SOURCE 700   //sigaction, setitimer, clock_gettime
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<assert.h>
+#include<time.h>
+#include<sys/time.h>
+#include"um_footprint.h" //Own header
+/**********************************************************************/
+volatile sig_atomic_t Footprint_due = 0;
+static volatile sig_atomic_t requested = 0;
+
+//A Row is one sample: the seconds since Footprint_start and the
+//counters then
+typedef struct Row {
+    double seconds;
+    Memseg_stats stats;
+} Row;
+
+//The samples taken so far, 'count' of the 'capacity' Rows
+static Row *rows;
+static size_t count, capacity;
+static double started;
+static const char *outPath;
+/**********************************************************************/
+//Function now returns the monotonic clock in seconds
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/**********************************************************************/
+//Function on_timer asks the memory space for a sample
+static void on_timer(int sig){
+    (void)sig;
+    Footprint_due = 1;
+}
+/**********************************************************************/
+//Function on_signal asks for a sample and for the series to be written
+static void on_signal(int sig){
+    (void)sig;
+    requested = 1;
+    Footprint_due = 1;
+}
+/**********************************************************************/
+//Function Footprint_start installs the handlers and arms the timer
+extern void Footprint_start(const char *path, unsigned interval){
+    outPath = path;
+    capacity = 1024;
+    count = 0;
+    rows = malloc(capacity * sizeof(Row));
+    assert(rows);
+    started = now();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_timer;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGALRM, &action, NULL) != 0){
+        fprintf(stderr, "Error, cannot install the footprint handler.\n");
+        exit(1);
+    }
+    action.sa_handler = on_signal;
+    sigaction(FOOTPRINT_SIGNAL, &action, NULL);
+
+    struct itimerval timer;
+    if (interval == 0){
+        interval = FOOTPRINT_INTERVAL;
+    }
+    timer.it_interval.tv_sec = interval / 1000;
+    timer.it_interval.tv_usec = (interval % 1000) * 1000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_REAL, &timer, NULL) != 0){
+        fprintf(stderr, "Error, cannot start the footprint timer.\n");
+        exit(1);
+    }
+}
+/**********************************************************************/
+//Function write_rows writes every sample so far to the file named by
+//Footprint_start
+static void write_rows(void){
+    size_t length = strlen(outPath);
+    char *partial = malloc(length + 6);
+    assert(partial);
+    memcpy(partial, outPath, length);
+    memcpy(partial + length, ".part", 6);
+
+    FILE *out = fopen(partial, "w");
+    if (out == NULL){
+        fprintf(stderr, "Error, cannot open footprint file %s.\n", partial);
+        exit(1);
+    }
+    fprintf(out, "seconds,segments,words,peak_segments,peak_words,maps,unmaps,"
+            "maps_per_s,unmaps_per_s,free_ids,peak_free_ids,host_bytes,"
+            "peak_host_bytes,held_bytes,size_0");
+    for (int k = 1; k < MEMSEG_BUCKETS; ++k){
+        fprintf(out, ",size_%" PRIu64, (uint64_t)1 << (k - 1));
+    }
+    fputc('\n', out);
+
+    for (size_t i = 0; i < count; ++i){
+        const Memseg_stats *s = &rows[i].stats;
+        double span = i > 0 ? rows[i].seconds - rows[i - 1].seconds : rows[i].seconds;
+        uint64_t maps = i > 0 ? s->maps - rows[i - 1].stats.maps : s->maps;
+        uint64_t unmaps = i > 0 ? s->unmaps - rows[i - 1].stats.unmaps : s->unmaps;
+        fprintf(out, "%.3f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+                ",%" PRIu64 ",%" PRIu64 ",%.0f,%.0f,%" PRIu64 ",%" PRIu64
+                ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+                rows[i].seconds, s->segments, s->words, s->peakSegments,
+                s->peakWords, s->maps, s->unmaps,
+                span > 0 ? maps / span : 0.0, span > 0 ? unmaps / span : 0.0,
+                s->freeIds, s->peakFreeIds, s->hostBytes, s->peakHostBytes,
+                s->bytesHeld);
+        for (int k = 0; k < MEMSEG_BUCKETS; ++k){
+            fprintf(out, ",%" PRIu64, s->sizes[k]);
+        }
+        fputc('\n', out);
+    }
+
+    if (ferror(out) || fclose(out) != 0 || rename(partial, outPath) != 0){
+        fprintf(stderr, "Error writing footprint file %s.\n", outPath);
+        exit(1);
+    }
+    free(partial);
+}
+/**********************************************************************/
+//Function Footprint_take appends a row, doubling the rows when full
+extern void Footprint_take(const Memseg_stats *stats){
+    Footprint_due = 0;
+    if (rows == NULL){
+        return;
+    }
+
+    if (count == capacity){
+        capacity *= 2;
+        rows = realloc(rows, capacity * sizeof(Row));
+        assert(rows);
+    }
+    rows[count].seconds = now() - started;
+    rows[count].stats = *stats;
+    ++count;
+
+    if (requested){
+        requested = 0;
+        write_rows();
+    }
+}
+/**********************************************************************/
+//Function Footprint_stop disarms the timer, takes the last row and
+//writes them all
+extern void Footprint_stop(const Memseg_stats *stats){
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_REAL, &timer, NULL);
+    if (rows == NULL){
+        return;
+    }
+
+    requested = 1;
+    Footprint_take(stats);
+    free(rows);
+    rows = NULL;
+}
+/**********************************************************************/
@@ -0,0 +1,35 @@
+//Timothy Colaneri
+//Universal Machine memory footprint interface
+
+/**********************************************************************/
+#ifndef FOOTPRINT_INCLUDED
+#define FOOTPRINT_INCLUDED
+#include <signal.h>
+#include "um_mem.h"
+/**********************************************************************/
+//Footprint_due is set by the footprint timer and by FOOTPRINT_SIGNAL,
+//and cleared by Footprint_take. A memory space checks it on each map,
+//unmap and load program, which is where its footprint changes, and
+//takes the sample there. Interp_prog_watched and Interp_prog_until
+//check it as well, so a program that runs without mapping anything
+//still has its samples taken and written; the other engines leave it
+//to the memory space.
+extern volatile sig_atomic_t Footprint_due;
+#define FOOTPRINT_SIGNAL SIGUSR1
+#define FOOTPRINT_INTERVAL 100 //milliseconds between samples
+/**********************************************************************/
+extern void Footprint_start(const char *path, unsigned interval);
+//Footprint_start starts a timer that asks for a sample of the memory
+//footprint every 'interval' milliseconds of wall clock time, and has
+//FOOTPRINT_SIGNAL ask for one that also writes the samples so far to
+//the file 'path'
+extern void Footprint_take(const Memseg_stats *stats);
+//Footprint_take records the footprint counters of 'stats' as one
+//sample, and writes the samples if FOOTPRINT_SIGNAL asked for them
+extern void Footprint_stop(const Memseg_stats *stats);
+//Footprint_stop records a last sample from 'stats', stops the timer
+//and writes the samples as CSV, one row per sample: the seconds since
+//Footprint_start, the counters, and the maps and unmaps per second
+//since the row before
+/**********************************************************************/
+#endif
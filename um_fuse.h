@@ -0,0 +1,35 @@
+//Timothy Colaneri
+//Universal Machine superinstruction table
+
+/**********************************************************************/
+#ifndef FUSE_INCLUDED
+#define FUSE_INCLUDED
+/**********************************************************************/
+//FUSE_SEQUENCES lists the runs of opcodes that the predecoder fuses
+//into a single superinstruction, each as TRIPLE(x, y, z) or PAIR(x, y).
+//A fused word still keeps its own registers; the handler for the
+//superinstruction also executes the one or two words after it without
+//dispatching them. Earlier entries win where sequences overlap, so the
+//triples come first.
+//
+//The set is not picked by hand: it is the head of the report written
+//by 'um --fusion-profile', run over midmark.um and sandmark.umz, with
+//each count being the executions of that run in straight-line code
+//over both images. A store, halt or load program can only end a
+//sequence, since the words after it might not run or be rewritten.
+#define FUSE_SEQUENCES(PAIR, TRIPLE)                                   \
+    TRIPLE(13, 1, 13)   /* 249603399 */                                \
+    TRIPLE(1, 13, 2)    /* 183942790 */                                \
+    TRIPLE(1, 13, 1)    /*  77441658 */                                \
+    TRIPLE(13, 13, 2)   /*  41628161 */                                \
+    PAIR(13, 1)         /* 335752741 */                                \
+    PAIR(13, 2)         /* 311245739 */                                \
+    PAIR(1, 13)         /* 274920911 */                                \
+    PAIR(13, 13)        /*  91422331 */                                \
+    PAIR(6, 6)          /*  59579180 */                                \
+    PAIR(1, 12)         /*  45645851 */                                \
+    PAIR(1, 2)          /*  44472817 */                                \
+    PAIR(3, 1)          /*  43148539 */
+#define FUSE_SPAN 3 //longest sequence in FUSE_SEQUENCES
+/**********************************************************************/
+#endif
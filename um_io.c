@@ -0,0 +1,503 @@
+//Timothy Colaneri
+//Universal Machine input/output implementation
+
+/**********************************************************************/
+#define _POSIX_C_SOURCE 200809L //open, read, write
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>   //strerror
+#include<errno.h>    //Interrupted system calls
+#include<fcntl.h>    //open
+#include<unistd.h>   //read, write
+#include<assert.h>   //Assertions
+#include<pthread.h>  //Output writer thread
+#include"um_io.h"    //Own header
+/**********************************************************************/
+#define INPUTSIZE (64 * 1024) //bytes asked of each read on stdin
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+#define LINE 64               //bytes in a cache line
+/**********************************************************************/
+//A Ring carries output from the machine to its writer thread. The
+//machine alone moves head and the writer alone moves tail, each one
+//publishing its own index and reading the other's atomically, so
+//neither takes the lock while the ring has room and bytes to write.
+//bytes[tail & mask] up to bytes[head & mask] are waiting. A side that
+//finds the ring full or empty sets its waiting flag and sleeps on its
+//condition under the lock, and the other signals it under the lock
+//after moving its index if it sees the flag. Every access to the
+//indexes and flags is sequentially consistent, so that a side that
+//goes to sleep has either been seen waiting or seen the other move.
+//head and tail sit on cache lines of their own.
+typedef struct Ring {
+    uint64_t head;
+    char headLine[LINE - sizeof(uint64_t)];
+    uint64_t tail;
+    char tailLine[LINE - sizeof(uint64_t)];
+    unsigned char *bytes;
+    size_t mask;
+    int fd;
+    int done, writerWaiting, machineWaiting;
+    pthread_mutex_t lock;
+    pthread_cond_t data, space;
+    pthread_t thread;
+} Ring;
+
+#define LOAD(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+/**********************************************************************/
+//An Umio_T holds the buffers between the machine and the outside
+//world. out[0] to out[outUsed - 1] is output that has not been
+//written yet, and outUsed never reaches threshold outside of
+//Umio_put. in[inNext] to in[inUsed - 1] is input that has been read
+//but not yet handed to the machine. checksum and bytes cover every
+//character output so far. Under UMIO_CALLBACK, read and write
+//stand in for the descriptors, or are NULL for none. log is the
+//file inputs are recorded to, and replay to replayEnd a log being
+//replayed, of which replayNext is the next entry. logged is the
+//clock of the last entry recorded or replayed, and inputs counts
+//the entries replayed. ring is the Ring to the writer thread, or
+//NULL when the machine writes its own output.
+#define T Umio_T
+struct T {
+    Umio_sink sink;
+    int outFd;
+    Umio_read *read;
+    Umio_write *write;
+    void *cl;
+    unsigned char *out;
+    size_t outUsed, threshold;
+    unsigned char in[INPUTSIZE];
+    size_t inNext, inUsed;
+    int inEnd;
+    uint64_t checksum, bytes;
+    FILE *log;
+    const char *logPath;
+    unsigned char *replay, *replayNext, *replayEnd;
+    const uint64_t *clock;
+    uint64_t logged, inputs;
+    Ring *ring;
+};
+/**********************************************************************/
+//Umio_new creates the I/O state for one machine
+extern T Umio_new(Umio_sink sink, const char *path, size_t threshold){
+    T io = malloc(sizeof(*io));
+    assert(io);
+
+    io->sink = sink;
+    io->outFd = STDOUT_FILENO;
+    io->read = NULL;
+    io->write = NULL;
+    io->cl = NULL;
+    if (sink == UMIO_FILE){
+        io->outFd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (io->outFd < 0){
+            fprintf(stderr, "Error opening %s: %s.\n", path, strerror(errno));
+            exit(1);
+        }
+    }
+
+    io->threshold = threshold > 0 ? threshold : 1;
+    io->out = malloc(io->threshold);
+    assert(io->out);
+    io->outUsed = 0;
+    io->inNext = io->inUsed = 0;
+    io->inEnd = 0;
+    io->checksum = FNV_OFFSET;
+    io->bytes = 0;
+    io->log = NULL;
+    io->logPath = NULL;
+    io->replay = io->replayNext = io->replayEnd = NULL;
+    io->clock = NULL;
+    io->logged = io->inputs = 0;
+    io->ring = NULL;
+    return io;
+}
+/**********************************************************************/
+//Umio_callbacks creates the I/O state for a machine run by a library
+//caller
+extern T Umio_callbacks(Umio_read *read, Umio_write *write, void *cl,
+                        size_t threshold){
+    T io = Umio_new(write != NULL ? UMIO_CALLBACK : UMIO_DISCARD, NULL, threshold);
+    io->read = read;
+    io->write = write;
+    io->cl = cl;
+    io->inEnd = read == NULL;
+    return io;
+}
+/**********************************************************************/
+//Umio_record opens the log every input is written to
+extern void Umio_record(T io, const char *path, const uint64_t *clock){
+    io->log = fopen(path, "wb");
+    if (io->log == NULL){
+        fprintf(stderr, "Error opening input log %s: %s.\n", path, strerror(errno));
+        exit(1);
+    }
+    fwrite(UMIO_LOG_MAGIC, 1, sizeof(UMIO_LOG_MAGIC), io->log);
+    io->logPath = path;
+    io->clock = clock;
+    io->logged = 0;
+}
+/**********************************************************************/
+//Umio_replay reads the whole log at 'path' into memory, past its magic
+extern void Umio_replay(T io, const char *path, const uint64_t *clock){
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening input log %s: %s.\n", path, strerror(errno));
+        exit(1);
+    }
+    char magic[sizeof(UMIO_LOG_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic)
+        || memcmp(magic, UMIO_LOG_MAGIC, sizeof(magic)) != 0){
+        fprintf(stderr, "Error, %s is not an input log.\n", path);
+        exit(1);
+    }
+    size_t size = 0, capacity = INPUTSIZE;
+    unsigned char *bytes = malloc(capacity);
+    assert(bytes);
+    size_t got;
+    while ((got = fread(bytes + size, 1, capacity - size, fp)) > 0){
+        size += got;
+        if (size == capacity){
+            capacity *= 2;
+            bytes = realloc(bytes, capacity);
+            assert(bytes);
+        }
+    }
+    if (ferror(fp)){
+        fprintf(stderr, "Error reading input log %s.\n", path);
+        exit(1);
+    }
+    fclose(fp);
+
+    free(io->replay);
+    io->replay = io->replayNext = bytes;
+    io->replayEnd = bytes + size;
+    io->clock = clock;
+    io->logged = 0;
+    io->inputs = 0;
+}
+/**********************************************************************/
+//Function log_varint writes 'value' to the log of 'io' as a varint
+static void log_varint(T io, uint64_t value){
+    while (value >= 0x80){
+        putc((int)(value & 0x7f) | 0x80, io->log);
+        value >>= 7;
+    }
+    putc((int)value, io->log);
+}
+/**********************************************************************/
+//Function replay_varint reads a varint from the log held in memory
+static uint64_t replay_varint(T io){
+    uint64_t value = 0;
+    for (unsigned shift = 0; io->replayNext < io->replayEnd && shift < 64; shift += 7){
+        unsigned char byte = *io->replayNext++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)){
+            return value;
+        }
+    }
+    fprintf(stderr, "Error, input log is corrupt.\n");
+    exit(1);
+}
+/**********************************************************************/
+//Function replay_next returns the next input of the log held in
+//memory, checking that it comes at the instruction it was logged at.
+//'logged' holds the clock of the entry before.
+static uint32_t replay_next(T io){
+    if (io->replayNext == io->replayEnd){
+        return ~(uint32_t)0;
+    }
+    io->logged += replay_varint(io);
+    uint64_t value = replay_varint(io);
+    if (io->clock != NULL && *io->clock != io->logged){
+        fprintf(stderr, "Error, input %" PRIu64 " of the replay was asked for after "
+                "%" PRIu64 " instructions, but was recorded after %" PRIu64 ".\n",
+                io->inputs, *io->clock, io->logged);
+        exit(1);
+    }
+    ++io->inputs;
+    return value == UMIO_LOG_END ? ~(uint32_t)0 : (uint32_t)value;
+}
+/**********************************************************************/
+//Function write_all writes the 'size' bytes at 'bytes' to 'fd',
+//retrying short writes
+static void write_all(int fd, const unsigned char *bytes, size_t size){
+    size_t done = 0;
+    while (done < size){
+        ssize_t wrote = write(fd, bytes + done, size - done);
+        if (wrote < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            fprintf(stderr, "Error writing output: %s.\n", strerror(errno));
+            exit(1);
+        }
+        done += (size_t)wrote;
+    }
+}
+/**********************************************************************/
+//Function writer is the writer thread. It writes whatever lies
+//between the tail and the head, up to the end of the ring at most,
+//in one write, and sleeps while the ring is empty until the machine
+//is done.
+static void *writer(void *cl){
+    Ring *ring = cl;
+    uint64_t tail = LOAD(&ring->tail);
+
+    while (1){
+        uint64_t head = LOAD(&ring->head);
+        if (head == tail){
+            if (LOAD(&ring->done)){
+                return NULL;
+            }
+            pthread_mutex_lock(&ring->lock);
+            STORE(&ring->writerWaiting, 1);
+            while (LOAD(&ring->head) == tail && !LOAD(&ring->done)){
+                pthread_cond_wait(&ring->data, &ring->lock);
+            }
+            STORE(&ring->writerWaiting, 0);
+            pthread_mutex_unlock(&ring->lock);
+            continue;
+        }
+
+        size_t at = (size_t)tail & ring->mask;
+        size_t size = (size_t)(head - tail);
+        if (size > ring->mask + 1 - at){
+            size = ring->mask + 1 - at;
+        }
+        write_all(ring->fd, ring->bytes + at, size);
+        tail += size;
+        STORE(&ring->tail, tail);
+        if (LOAD(&ring->machineWaiting)){
+            pthread_mutex_lock(&ring->lock);
+            pthread_cond_signal(&ring->space);
+            pthread_mutex_unlock(&ring->lock);
+        }
+    }
+}
+/**********************************************************************/
+//Function wait_tail sleeps until the writer moves the tail of 'ring'
+//off 'tail', which is where the machine last saw it
+static void wait_tail(Ring *ring, uint64_t tail){
+    pthread_mutex_lock(&ring->lock);
+    STORE(&ring->machineWaiting, 1);
+    while (LOAD(&ring->tail) == tail){
+        pthread_cond_wait(&ring->space, &ring->lock);
+    }
+    STORE(&ring->machineWaiting, 0);
+    pthread_mutex_unlock(&ring->lock);
+}
+/**********************************************************************/
+//Function push copies the 'size' bytes at 'bytes' into 'ring' as
+//room allows, waking the writer as they go in, and waits on the
+//writer only while the ring is full
+static void push(Ring *ring, const unsigned char *bytes, size_t size){
+    uint64_t head = ring->head;
+    size_t capacity = ring->mask + 1;
+
+    while (size > 0){
+        uint64_t tail = LOAD(&ring->tail);
+        size_t room = capacity - (size_t)(head - tail);
+        if (room == 0){
+            wait_tail(ring, tail);
+            continue;
+        }
+        size_t at = (size_t)head & ring->mask;
+        size_t n = size < room ? size : room;
+        if (n > capacity - at){
+            n = capacity - at;
+        }
+        memcpy(ring->bytes + at, bytes, n);
+        head += n;
+        bytes += n;
+        size -= n;
+        STORE(&ring->head, head);
+        if (LOAD(&ring->writerWaiting)){
+            pthread_mutex_lock(&ring->lock);
+            pthread_cond_signal(&ring->data);
+            pthread_mutex_unlock(&ring->lock);
+        }
+    }
+}
+/**********************************************************************/
+//Function drain waits until the writer has written everything in
+//'ring'
+static void drain(Ring *ring){
+    uint64_t tail;
+    while ((tail = LOAD(&ring->tail)) != ring->head){
+        wait_tail(ring, tail);
+    }
+}
+/**********************************************************************/
+//Umio_async starts the writer thread on a ring of its own
+extern void Umio_async(T io, size_t ring){
+    if ((io->sink != UMIO_STDOUT && io->sink != UMIO_FILE) || io->ring != NULL){
+        return;
+    }
+    size_t capacity = LINE;
+    while (capacity < ring){
+        capacity *= 2;
+    }
+
+    Ring *r = malloc(sizeof(*r));
+    assert(r);
+    r->bytes = malloc(capacity);
+    assert(r->bytes);
+    r->mask = capacity - 1;
+    r->head = r->tail = 0;
+    r->fd = io->outFd;
+    r->done = r->writerWaiting = r->machineWaiting = 0;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->data, NULL);
+    pthread_cond_init(&r->space, NULL);
+
+    //Anything buffered so far goes out first, from this thread
+    Umio_flush(io);
+    if (pthread_create(&r->thread, NULL, writer, r) != 0){
+        fprintf(stderr, "Error, cannot start the output writer.\n");
+        exit(1);
+    }
+    io->ring = r;
+}
+/**********************************************************************/
+//Function stop drains the ring of 'io', then stops and joins the
+//writer thread and frees the ring
+static void stop(T io){
+    Ring *ring = io->ring;
+    drain(ring);
+    pthread_mutex_lock(&ring->lock);
+    STORE(&ring->done, 1);
+    pthread_cond_signal(&ring->data);
+    pthread_mutex_unlock(&ring->lock);
+    pthread_join(ring->thread, NULL);
+
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->data);
+    pthread_cond_destroy(&ring->space);
+    free(ring->bytes);
+    free(ring);
+    io->ring = NULL;
+}
+/**********************************************************************/
+//Umio_put outputs the low 8 bits of 'c'. The checksum is kept for
+//every sink; only the checksum and discard sinks skip the buffer.
+extern void Umio_put(T io, uint32_t c){
+    unsigned char byte = (unsigned char)c;
+    io->checksum = (io->checksum ^ byte) * FNV_PRIME;
+    ++io->bytes;
+
+    if (io->sink == UMIO_CHECKSUM || io->sink == UMIO_DISCARD){
+        return;
+    }
+    io->out[io->outUsed++] = byte;
+    if (io->outUsed == io->threshold){
+        if (io->ring != NULL){
+            push(io->ring, io->out, io->outUsed);
+            io->outUsed = 0;
+        }
+        else{
+            Umio_flush(io);
+        }
+    }
+}
+/**********************************************************************/
+//Umio_flush writes out all pending output, retrying short writes,
+//or hands it to the writer thread and waits for the ring to drain
+extern void Umio_flush(T io){
+    if (io->sink == UMIO_CALLBACK){
+        if (io->outUsed > 0){
+            io->write(io->cl, io->out, io->outUsed);
+        }
+        io->outUsed = 0;
+        return;
+    }
+
+    if (io->ring != NULL){
+        push(io->ring, io->out, io->outUsed);
+        drain(io->ring);
+    }
+    else{
+        write_all(io->outFd, io->out, io->outUsed);
+    }
+    io->outUsed = 0;
+}
+/**********************************************************************/
+//Function next_input returns the next byte of input, reading more
+//when the buffer is empty. Pending output is written out before a
+//read, which may wait, so that a prompt is seen before the machine
+//waits on its answer. So is a recording, so that a session cut short
+//keeps what came before.
+static uint32_t next_input(T io){
+    while (io->inNext == io->inUsed){
+        if (io->inEnd){
+            return ~(uint32_t)0;
+        }
+        if (io->outUsed > 0 || io->ring != NULL){
+            Umio_flush(io);
+        }
+        if (io->log != NULL){
+            fflush(io->log);
+        }
+        ssize_t got;
+        if (io->read != NULL){
+            got = (ssize_t)io->read(io->cl, io->in, INPUTSIZE);
+        }
+        else{
+            got = read(STDIN_FILENO, io->in, INPUTSIZE);
+        }
+        if (got < 0 && errno == EINTR){
+            continue;
+        }
+        if (got <= 0){
+            io->inEnd = 1;
+            continue;
+        }
+        io->inNext = 0;
+        io->inUsed = (size_t)got;
+    }
+    return io->in[io->inNext++];
+}
+/**********************************************************************/
+//Umio_get returns the next input byte, from a replayed log if there
+//is one, logging it if recording. Input still in the buffer, or in a
+//replayed log, is handed over without writing any output, so the
+//machine never waits on the writer thread for it.
+extern uint32_t Umio_get(T io){
+    if (io->replay != NULL){
+        return replay_next(io);
+    }
+    uint32_t c = next_input(io);
+    if (io->log != NULL){
+        uint64_t clock = io->clock != NULL ? *io->clock : 0;
+        log_varint(io, clock - io->logged);
+        log_varint(io, c == ~(uint32_t)0 ? UMIO_LOG_END : c);
+        io->logged = clock;
+    }
+    return c;
+}
+/**********************************************************************/
+//Umio_checksum returns the checksum of everything output so far
+extern uint64_t Umio_checksum(T io, uint64_t *bytes){
+    *bytes = io->bytes;
+    return io->checksum;
+}
+/**********************************************************************/
+//Umio_free flushes pending output and frees 'io'
+extern void Umio_free(T io){
+    Umio_flush(io);
+    if (io->ring != NULL){
+        stop(io);
+    }
+    if (io->sink == UMIO_FILE){
+        close(io->outFd);
+    }
+    if (io->log != NULL && (ferror(io->log) || fclose(io->log) != 0)){
+        fprintf(stderr, "Error writing input log %s.\n", io->logPath);
+        exit(1);
+    }
+    free(io->replay);
+    free(io->out);
+    free(io);
+}
+/**********************************************************************/
@@ -0,0 +1,87 @@
+//Timothy Colaneri
+//Universal Machine input/output interface
+
+/**********************************************************************/
+#ifndef UMIO_INCLUDED
+#define UMIO_INCLUDED
+#include <inttypes.h>
+#include <stddef.h>
+#define T Umio_T
+typedef struct T *T;
+/**********************************************************************/
+//An Umio_sink names where the output instruction's characters go.
+//UMIO_DISCARD drops them and UMIO_CHECKSUM only folds them into a
+//running checksum, so a benchmark can check its output without
+//paying for the writes. UMIO_CALLBACK hands the output to the
+//caller, as set up by Umio_callbacks.
+typedef enum Umio_sink {
+    UMIO_STDOUT, UMIO_FILE, UMIO_DISCARD, UMIO_CHECKSUM, UMIO_CALLBACK
+} Umio_sink;
+//An Umio_read fills up to 'size' bytes of 'buffer' with input
+//and returns how many it filled, 0 once the input is exhausted.
+//An Umio_write takes 'size' bytes of output. Both get back the
+//closure 'cl' given to Umio_callbacks.
+typedef size_t Umio_read(void *cl, unsigned char *buffer, size_t size);
+typedef void Umio_write(void *cl, const unsigned char *bytes, size_t size);
+
+#define UMIO_THRESHOLD (64 * 1024) //default output flush threshold
+#define UMIO_RING (1 << 20)        //default bytes in an output ring
+
+//An input log is UMIO_LOG_MAGIC, with its NUL, followed by one
+//entry for each input: the instructions run since the one before,
+//then the byte read, or 256 for the end of input, each as a varint
+//of seven bits a byte, lowest first, with the top bit set on every
+//byte but the last. An interactive session logs two or three bytes
+//for each byte typed.
+#define UMIO_LOG_MAGIC "UMINPUT"
+#define UMIO_LOG_END 256
+/**********************************************************************/
+extern T Umio_new(Umio_sink sink, const char *path, size_t threshold);
+//Umio_new creates the I/O state for one machine. Input comes from
+//stdin; output goes to 'sink', which for UMIO_FILE is the file at
+//'path'. Output is buffered and written once 'threshold' bytes are
+//waiting, before every input and when the machine is freed.
+extern T Umio_callbacks(Umio_read *read, Umio_write *write, void *cl,
+                        size_t threshold);
+//Umio_callbacks creates I/O state that takes its input from 'read'
+//and gives its output to 'write', buffered as for Umio_new, so the
+//machine touches neither stdin nor stdout. A NULL 'read' gives the
+//machine no input and a NULL 'write' discards its output.
+extern void Umio_record(T io, const char *path, const uint64_t *clock);
+//Umio_record logs every input byte 'io' hands the machine from now
+//on, and every end of input, to a new file at 'path', each with the
+//value '*clock' held when it was asked for. A NULL 'clock' logs 0.
+//The log is written out whenever the machine waits on input, and
+//closed by Umio_free.
+extern void Umio_replay(T io, const char *path, const uint64_t *clock);
+//Umio_replay reads the log at 'path', written by Umio_record, into
+//memory, and from then on hands the machine its bytes in place of
+//any other input, without a system call, and the end of input once
+//they run out. Unless 'clock' is NULL, an input asked for when
+//'*clock' is not the value logged with it is a fatal error, as the
+//run has stopped repeating the one recorded.
+extern void Umio_async(T io, size_t ring);
+//Umio_async hands the output of 'io' to a writer thread of its own,
+//through a ring of 'ring' bytes, rounded up to a power of 2. Each
+//time 'threshold' bytes are waiting they are copied into the ring,
+//and the machine only waits on the writer when the ring is full.
+//Umio_flush, and so every read of input and Umio_free, waits for
+//the ring to drain. Only UMIO_STDOUT and UMIO_FILE have anything to
+//write, so for the other sinks it does nothing.
+extern void Umio_put(T io, uint32_t c);
+//Umio_put outputs the low 8 bits of 'c'
+extern uint32_t Umio_get(T io);
+//Umio_get returns the next input byte, or all ones once the input
+//is exhausted. Pending output is written out first whenever more
+//input has to be read, which may wait.
+extern void Umio_flush(T io);
+//Umio_flush writes out all pending output, and returns once it
+//has been written
+extern uint64_t Umio_checksum(T io, uint64_t *bytes);
+//Umio_checksum returns the FNV-1a checksum of everything output so
+//far, whatever the sink, and stores the number of bytes into 'bytes'
+extern void Umio_free(T io);
+//Umio_free flushes pending output and frees 'io'
+/**********************************************************************/
+#undef T
+#endif
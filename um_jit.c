@@ -0,0 +1,596 @@
+//Timothy Colaneri
+//Universal Machine x86-64 JIT implementation
+
+/* Interp_prog_jit translates basic blocks of segment 0 into x86-64
+machine code the first time they are reached and then runs them
+natively. A block starts at any jump target and runs to the next
+load program or halt, or until MAXBLOCK instructions.
+
+While translated code runs, the UM registers live in host
+registers: r0-r4 in the callee-saved ebp and r12d-r15d, r5-r7 in
+r8d-r10d, which are saved in the Jit_state around every call into
+C. rbx points at the Jit_state, which also caches the segment table.
+Blocks never jump to each other directly; a jump within segment 0
+looks its target up in 'entries', so dropping a block only takes
+clearing its entry.
+
+Control returns to the C loop in Interp_prog_jit through a shared
+exit stub whenever a block cannot go on by itself: at halt, at a
+fault, at a jump to an untranslated address, at a load program from another
+segment, and after a store into a translated word of segment 0. The
+last two throw away translations, which is only safe while no
+translated code is running.
+
+Machines that are not x86-64 Linux run Interp_prog_threaded.*/
+
+/*****************************************************************/
+#define _DEFAULT_SOURCE     //MAP_ANONYMOUS
+#include"um_exec.h"
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<assert.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include<stddef.h>          //offsetof
+#include<sys/mman.h>        //mmap
+
+#define CODESIZE (32 << 20) //bytes of translated code before a flush
+#define MAXBLOCK 256        //instructions in one block
+#define MAXINSTR 160        //bytes one instruction may translate to
+#define MAXTAIL  64         //bytes a block ending may translate to
+/*****************************************************************/
+//The reasons translated code hands control back to C
+enum { EXIT_MISS, EXIT_HALT, EXIT_FAR, EXIT_WRITE, EXIT_FAULT };
+
+//x86-64 register numbers
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+       R8, R9, R10, R11, R12, R13, R14, R15 };
+
+//The host register holding each UM register. The last three are
+//caller-saved and must be spilled around calls.
+static const int hreg[8] = { RBP, R12, R13, R14, R15, R8, R9, R10 };
+#define FIRST_SPILLED 5
+/*****************************************************************/
+//A Jit_state is what translated code sees through rbx. r holds the
+//UM registers whenever C is running. table caches the segment table
+//and is refreshed after every call that can move it. entries[pc] is
+//the translation of the block starting at pc, or NULL, for the
+//'length' words of segment 0. pc, reason, farSeg and farPc, the PC
+//of a load program from another segment, describe the last exit,
+//and fault is the Interp_status of an exit for a fault.
+typedef struct Jit_state {
+    uint32_t r[8];
+    uintptr_t *table;
+    void **entries;
+    uint32_t length;
+    uint32_t pc, reason, farSeg, farPc, fault;
+    Memseg_T program;
+    Umio_T io;
+    struct Jit *jit;
+} Jit_state;
+/*****************************************************************/
+//A Block records the words [start, end) of segment 0 that one
+//translation was made from.
+typedef struct Block {
+    uint32_t start, end;
+} Block;
+//A Jit holds the code buffer and the bookkeeping for translated
+//blocks. code[0] to code[used - 1] is in use; the trampoline and
+//stubs at its start survive every flush. cover[pc] counts the live
+//blocks translated from word pc, and blocks[0] to
+//blocks[blockCount - 1] are the live blocks.
+typedef struct Jit {
+    unsigned char *code;
+    size_t used, stubsEnd;
+    void *enter, *exitStub, *dispatchStub;
+    uint16_t *cover;
+    Block *blocks;
+    uint32_t blockCount, blockCapacity;
+    Jit_state state;
+} *Jit;
+/*****************************************************************/
+//These emit bytes and instructions into the code buffer
+static inline void byte(Jit j, unsigned b){
+    j->code[j->used++] = (unsigned char)b;
+}
+static inline void imm32(Jit j, uint32_t v){
+    memcpy(j->code + j->used, &v, 4);
+    j->used += 4;
+}
+static inline void imm64(Jit j, uint64_t v){
+    memcpy(j->code + j->used, &v, 8);
+    j->used += 8;
+}
+//Function rex emits a REX prefix if one is needed for the 64 bit
+//operand size 'w' or for registers r8-r15 in the reg, index and
+//base fields.
+static inline void rex(Jit j, int w, int reg, int index, int base){
+    unsigned prefix = 0x40 | (w << 3) | ((reg >> 3) & 1) << 2 |
+                      ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+    if (prefix != 0x40){
+        byte(j, prefix);
+    }
+}
+//Function reg_op emits 'op' with a register-direct operand pair
+static void reg_op(Jit j, int w, unsigned op, int reg, int rm){
+    rex(j, w, reg, 0, rm);
+    if (op > 0xFF){
+        byte(j, op >> 8);
+    }
+    byte(j, op & 0xFF);
+    byte(j, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+//Function mem_op emits 'op' with the memory operand
+//[base + index * scale + disp]; index is -1 for none
+static void mem_op(Jit j, int w, unsigned op, int reg, int base, int index,
+                   int scale, int32_t disp){
+    rex(j, w, reg, index < 0 ? 0 : index, base);
+    if (op > 0xFF){
+        byte(j, op >> 8);
+    }
+    byte(j, op & 0xFF);
+
+    int mod = (disp == 0 && (base & 7) != RBP) ? 0 :
+              (disp >= -128 && disp <= 127) ? 1 : 2;
+    if (index < 0 && (base & 7) != RSP){
+        byte(j, mod << 6 | (reg & 7) << 3 | (base & 7));
+    }
+    else{
+        int ss = scale == 8 ? 3 : scale == 4 ? 2 : scale == 2 ? 1 : 0;
+        byte(j, mod << 6 | (reg & 7) << 3 | RSP);
+        byte(j, ss << 6 | ((index < 0 ? RSP : index) & 7) << 3 | (base & 7));
+    }
+    if (mod == 1){
+        byte(j, (unsigned)disp & 0xFF);
+    }
+    else if (mod == 2){
+        imm32(j, (uint32_t)disp);
+    }
+}
+
+#define MOV_LOAD   0x8B
+#define MOV_STORE  0x89
+#define ADD        0x01
+#define AND        0x21
+#define TEST       0x85
+#define CMP_LOAD   0x3B
+#define IMUL       0x0FAF
+#define CMOVNE     0x0F45
+
+static void mov_imm(Jit j, int reg, uint32_t v){
+    rex(j, 0, 0, 0, reg);
+    byte(j, 0xB8 + (reg & 7));
+    imm32(j, v);
+}
+static void mov_imm64(Jit j, int reg, uint64_t v){
+    rex(j, 1, 0, 0, reg);
+    byte(j, 0xB8 + (reg & 7));
+    imm64(j, v);
+}
+//Function jump_to emits a jmp (0xE9) or jcc (0x0F 0x8?) to 'target'
+static void jump_to(Jit j, unsigned op, void *target){
+    if (op > 0xFF){
+        byte(j, op >> 8);
+    }
+    byte(j, op & 0xFF);
+    int32_t rel = (int32_t)((unsigned char *)target - (j->code + j->used + 4));
+    imm32(j, (uint32_t)rel);
+}
+#define JMP 0xE9
+#define JNZ 0x0F85
+#define JZ  0x0F84
+#define JAE 0x0F83
+//Function forward emits a jcc with a rel32 to be patched later and
+//returns where the rel32 sits
+static size_t forward(Jit j, unsigned op){
+    jump_to(j, op, j->code + j->used + (op > 0xFF ? 6 : 5));
+    return j->used - 4;
+}
+static void patch(Jit j, size_t at){
+    int32_t rel = (int32_t)(j->used - (at + 4));
+    memcpy(j->code + at, &rel, 4);
+}
+#define STATE(field) ((int32_t)offsetof(Jit_state, field))
+/*****************************************************************/
+//These save and restore the caller-saved UM registers around a
+//call into C, and emit the call itself
+static void spill(Jit j){
+    for (int i = FIRST_SPILLED; i < 8; ++i){
+        mem_op(j, 0, MOV_STORE, hreg[i], RBX, -1, 1, STATE(r) + 4 * i);
+    }
+}
+static void unspill(Jit j){
+    for (int i = FIRST_SPILLED; i < 8; ++i){
+        mem_op(j, 0, MOV_LOAD, hreg[i], RBX, -1, 1, STATE(r) + 4 * i);
+    }
+}
+static void call(Jit j, uint64_t function){
+    mov_imm64(j, RAX, function);
+    byte(j, 0xFF);
+    byte(j, 0xD0); //call rax
+}
+#define FUNCTION(f) ((uint64_t)(uintptr_t)(f))
+/*****************************************************************/
+//These are the C functions translated code calls
+//Each returns MEMSEG_NONE or 0 for a fault, after setting 'fault'
+static uint32_t jit_map(Jit_state *state, uint32_t size){
+    uint32_t seg = Memseg_map(state->program, size);
+    state->table = Memseg_table(state->program);
+    state->fault = INTERP_MEMORY;
+    return seg;
+}
+static uint32_t jit_unmap(Jit_state *state, uint32_t seg){
+    state->fault = INTERP_UNMAPPED;
+    return (uint32_t)Memseg_unmap(state->program, seg);
+}
+//Function jit_store performs a store that needs Memseg_store and
+//returns 1 if it overwrote translated code, after dropping every
+//block translated from the word it wrote, and 2 if it could not
+//store at all
+static uint32_t jit_store(Jit_state *state, uint32_t seg, uint32_t offset,
+                          uint32_t value){
+    if (!Memseg_store(state->program, value, seg, offset)){
+        state->fault = INTERP_MEMORY;
+        return 2;
+    }
+    Jit j = state->jit;
+    if (seg != 0 || offset >= state->length || j->cover[offset] == 0){
+        return 0;
+    }
+
+    uint32_t i = 0;
+    while (i < j->blockCount){
+        Block block = j->blocks[i];
+        if (block.start <= offset && offset < block.end){
+            state->entries[block.start] = NULL;
+            for (uint32_t pc = block.start; pc < block.end; ++pc){
+                --j->cover[pc];
+            }
+            j->blocks[i] = j->blocks[--j->blockCount];
+        }
+        else{
+            ++i;
+        }
+    }
+    return 1;
+}
+/*****************************************************************/
+//Function exit_to emits a return to C at 'pc' for 'reason'
+static void exit_to(Jit j, uint32_t pc, uint32_t reason){
+    mov_imm(j, RAX, pc);
+    mov_imm(j, RCX, reason);
+    jump_to(j, JMP, j->exitStub);
+}
+//Function emit_stubs emits the code shared by all blocks: the
+//trampoline C calls to enter translated code, the exit stub that
+//returns to C with eax holding the pc and ecx the reason, and the
+//dispatch stub that continues at the pc in eax
+static void emit_stubs(Jit j){
+
+    //enter(state, target): save the callee-saved registers, load
+    //the UM registers and jump to the block
+    j->enter = j->code + j->used;
+    byte(j, 0x53);                               //push rbx
+    byte(j, 0x55);                               //push rbp
+    byte(j, 0x41); byte(j, 0x54);                //push r12
+    byte(j, 0x41); byte(j, 0x55);                //push r13
+    byte(j, 0x41); byte(j, 0x56);                //push r14
+    byte(j, 0x41); byte(j, 0x57);                //push r15
+    byte(j, 0x48); byte(j, 0x83); byte(j, 0xEC); byte(j, 0x08); //sub rsp, 8
+    reg_op(j, 1, MOV_STORE, RDI, RBX);           //mov rbx, rdi
+    for (int i = 0; i < 8; ++i){
+        mem_op(j, 0, MOV_LOAD, hreg[i], RBX, -1, 1, STATE(r) + 4 * i);
+    }
+    byte(j, 0xFF); byte(j, 0xE6);                //jmp rsi
+
+    //exit: store the pc, reason and UM registers and return
+    j->exitStub = j->code + j->used;
+    mem_op(j, 0, MOV_STORE, RAX, RBX, -1, 1, STATE(pc));
+    mem_op(j, 0, MOV_STORE, RCX, RBX, -1, 1, STATE(reason));
+    for (int i = 0; i < 8; ++i){
+        mem_op(j, 0, MOV_STORE, hreg[i], RBX, -1, 1, STATE(r) + 4 * i);
+    }
+    byte(j, 0x48); byte(j, 0x83); byte(j, 0xC4); byte(j, 0x08); //add rsp, 8
+    byte(j, 0x41); byte(j, 0x5F);                //pop r15
+    byte(j, 0x41); byte(j, 0x5E);                //pop r14
+    byte(j, 0x41); byte(j, 0x5D);                //pop r13
+    byte(j, 0x41); byte(j, 0x5C);                //pop r12
+    byte(j, 0x5D);                               //pop rbp
+    byte(j, 0x5B);                               //pop rbx
+    byte(j, 0xC3);                               //ret
+
+    //dispatch: jump to the translation of pc eax if there is one
+    j->dispatchStub = j->code + j->used;
+    mem_op(j, 0, CMP_LOAD, RAX, RBX, -1, 1, STATE(length));
+    size_t outside = forward(j, JAE);
+    mem_op(j, 1, MOV_LOAD, RDX, RBX, -1, 1, STATE(entries));
+    mem_op(j, 1, MOV_LOAD, RDX, RDX, RAX, 8, 0);
+    reg_op(j, 1, TEST, RDX, RDX);
+    size_t missing = forward(j, JZ);
+    byte(j, 0xFF); byte(j, 0xE2);                //jmp rdx
+    patch(j, outside);
+    patch(j, missing);
+    mov_imm(j, RCX, EXIT_MISS);
+    jump_to(j, JMP, j->exitStub);
+
+    j->stubsEnd = j->used;
+}
+/*****************************************************************/
+//Function emit_segment_entry loads the table entry for the segment
+//named by UM register 'seg' into rax
+static void emit_segment_entry(Jit j, int seg){
+    mem_op(j, 1, MOV_LOAD, RAX, RBX, -1, 1, STATE(table));
+    reg_op(j, 0, MOV_STORE, hreg[seg], RCX);    //mov ecx, seg
+    mem_op(j, 1, MOV_LOAD, RAX, RAX, RCX, 8, 0);
+}
+//Function emit_word translates the instruction 'word' found at 'pc'.
+//It returns 0 if the instruction ends the block.
+static int emit_word(Jit j, uint32_t word, uint32_t pc){
+    Codeword cw = Decode_word(word);
+    int a = hreg[cw.a], b = hreg[cw.b], c = hreg[cw.c];
+
+    switch (cw.opcode){
+        case 0:                                  //CONDITIONAL MOVE
+            reg_op(j, 0, TEST, c, c);
+            reg_op(j, 0, CMOVNE, a, b);
+            return 1;
+        case 1:                                  //SEGMENTED LOAD
+            emit_segment_entry(j, cw.b);
+            byte(j, 0x48); byte(j, 0x83); byte(j, 0xE0); //and rax, ~flags
+            byte(j, (unsigned)~MEMSEG_FLAGS & 0xFF);
+            reg_op(j, 0, MOV_STORE, c, RCX);
+            mem_op(j, 0, MOV_LOAD, a, RAX, RCX, 4, MEMSEG_WORDS);
+            return 1;
+        case 2: {                                //SEGMENTED STORE
+            //Flagged segments and segment 0 need jit_store
+            reg_op(j, 0, TEST, a, a);
+            size_t zero = forward(j, JZ);
+            emit_segment_entry(j, cw.a);
+            byte(j, 0xA8); byte(j, MEMSEG_FLAGS); //test al, flags
+            size_t flagged = forward(j, JNZ);
+            reg_op(j, 0, MOV_STORE, b, RCX);
+            mem_op(j, 0, MOV_STORE, c, RAX, RCX, 4, MEMSEG_WORDS);
+            size_t done = forward(j, JMP);
+
+            patch(j, zero);
+            patch(j, flagged);
+            spill(j);
+            reg_op(j, 0, MOV_STORE, a, RSI);
+            reg_op(j, 0, MOV_STORE, b, RDX);
+            reg_op(j, 0, MOV_STORE, c, RCX);
+            reg_op(j, 1, MOV_STORE, RBX, RDI);
+            call(j, FUNCTION(jit_store));
+            unspill(j);
+            reg_op(j, 0, TEST, RAX, RAX);
+            size_t unchanged = forward(j, JZ);
+            byte(j, 0x83); byte(j, 0xF8); byte(j, 0x01); //cmp eax, 1
+            size_t failed = forward(j, JNZ);
+            exit_to(j, pc + 1, EXIT_WRITE);
+            patch(j, failed);
+            exit_to(j, pc, EXIT_FAULT);
+            patch(j, unchanged);
+            patch(j, done);
+            return 1;
+        }
+        case 3:                                  //ADDITION
+            reg_op(j, 0, MOV_STORE, b, RAX);
+            reg_op(j, 0, ADD, c, RAX);
+            reg_op(j, 0, MOV_STORE, RAX, a);
+            return 1;
+        case 4:                                  //MULTIPLICATION
+            reg_op(j, 0, MOV_STORE, b, RAX);
+            reg_op(j, 0, IMUL, RAX, c);
+            reg_op(j, 0, MOV_STORE, RAX, a);
+            return 1;
+        case 5:                                  //DIVISION
+            reg_op(j, 0, MOV_STORE, b, RAX);
+            byte(j, 0x31); byte(j, 0xD2);        //xor edx, edx
+            rex(j, 0, 0, 0, c);
+            byte(j, 0xF7); byte(j, 0xF0 | (c & 7)); //div c
+            reg_op(j, 0, MOV_STORE, RAX, a);
+            return 1;
+        case 6:                                  //BITWISE NAND
+            reg_op(j, 0, MOV_STORE, b, RAX);
+            reg_op(j, 0, AND, c, RAX);
+            byte(j, 0xF7); byte(j, 0xD0);        //not eax
+            reg_op(j, 0, MOV_STORE, RAX, a);
+            return 1;
+        case 7:                                  //HALT
+            exit_to(j, pc, EXIT_HALT);
+            return 0;
+        case 8:                                  //MAP SEGMENT
+            spill(j);
+            reg_op(j, 0, MOV_STORE, c, RSI);
+            reg_op(j, 1, MOV_STORE, RBX, RDI);
+            call(j, FUNCTION(jit_map));
+            unspill(j);
+            byte(j, 0x83); byte(j, 0xF8); byte(j, 0xFF); //cmp eax, MEMSEG_NONE
+            size_t mapped = forward(j, JNZ);
+            exit_to(j, pc, EXIT_FAULT);
+            patch(j, mapped);
+            reg_op(j, 0, MOV_STORE, RAX, b);
+            return 1;
+        case 9:                                  //UNMAP SEGMENT
+            spill(j);
+            reg_op(j, 0, MOV_STORE, c, RSI);
+            reg_op(j, 1, MOV_STORE, RBX, RDI);
+            call(j, FUNCTION(jit_unmap));
+            unspill(j);
+            reg_op(j, 0, TEST, RAX, RAX);
+            size_t unmapped = forward(j, JNZ);
+            exit_to(j, pc, EXIT_FAULT);
+            patch(j, unmapped);
+            return 1;
+        case 10:                                 //IO OUTPUT
+            spill(j);
+            reg_op(j, 0, MOV_STORE, c, RSI);
+            mem_op(j, 1, MOV_LOAD, RDI, RBX, -1, 1, STATE(io));
+            call(j, FUNCTION(Umio_put));
+            unspill(j);
+            return 1;
+        case 11:                                 //IO INPUT
+            spill(j);
+            mem_op(j, 1, MOV_LOAD, RDI, RBX, -1, 1, STATE(io));
+            call(j, FUNCTION(Umio_get));
+            unspill(j);
+            reg_op(j, 0, MOV_STORE, RAX, c);
+            return 1;
+        case 12: {                               //LOAD PROGRAM
+            //Another segment replaces every translation, which C
+            //has to do
+            reg_op(j, 0, TEST, b, b);
+            size_t near = forward(j, JZ);
+            mem_op(j, 0, MOV_STORE, b, RBX, -1, 1, STATE(farSeg));
+            mov_imm(j, RDX, pc);
+            mem_op(j, 0, MOV_STORE, RDX, RBX, -1, 1, STATE(farPc));
+            reg_op(j, 0, MOV_STORE, c, RAX);
+            mov_imm(j, RCX, EXIT_FAR);
+            jump_to(j, JMP, j->exitStub);
+            patch(j, near);
+            reg_op(j, 0, MOV_STORE, c, RAX);
+            jump_to(j, JMP, j->dispatchStub);
+            return 0;
+        }
+        case 13:                                 //LOAD VALUE
+            mov_imm(j, hreg[cw.a], cw.value);
+            return 1;
+        default:                                 //Ignored, as by Interp_prog
+            return 1;
+    }
+}
+/*****************************************************************/
+//Function flush drops every translation and empties the code
+//buffer down to the stubs, sizing the block bookkeeping for the
+//current segment 0
+static void flush(Jit j){
+    Jit_state *state = &j->state;
+    uint32_t length;
+    Memseg_segment(state->program, 0, &length);
+
+    free(state->entries);
+    free(j->cover);
+    state->entries = calloc(length + 1, sizeof(void *));
+    j->cover = calloc(length + 1, sizeof(uint16_t));
+    assert(state->entries && j->cover);
+    state->length = length;
+    j->blockCount = 0;
+    j->used = j->stubsEnd;
+}
+//Function translate translates the block starting at 'pc' and
+//returns its entry point
+static void *translate(Jit j, uint32_t pc){
+    Jit_state *state = &j->state;
+    if (CODESIZE - j->used < MAXBLOCK * MAXINSTR + MAXTAIL){
+        flush(j);
+    }
+    if (j->blockCount == j->blockCapacity){
+        j->blockCapacity = 2 * j->blockCapacity + 16;
+        j->blocks = realloc(j->blocks, j->blockCapacity * sizeof(Block));
+        assert(j->blocks);
+    }
+
+    uint32_t length;
+    const uint32_t *words = Memseg_segment(state->program, 0, &length);
+    void *entry = j->code + j->used;
+    uint32_t end = pc;
+    int open = 1;
+
+    while (open && end < length && end - pc < MAXBLOCK){
+        open = emit_word(j, words[end], end);
+        ++j->cover[end];
+        ++end;
+    }
+
+    //Run on into the next block, or out of segment 0
+    if (open){
+        mov_imm(j, RAX, end);
+        jump_to(j, JMP, j->dispatchStub);
+    }
+
+    j->blocks[j->blockCount].start = pc;
+    j->blocks[j->blockCount].end = end;
+    ++j->blockCount;
+    state->entries[pc] = entry;
+    return entry;
+}
+/*****************************************************************/
+//Interp_prog_jit runs the program through translated blocks,
+//translating each block the first time it is reached
+extern Interp_status Interp_prog_jit(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                    Umio_T io){
+
+    struct Jit jit;
+    Jit j = &jit;
+    memset(j, 0, sizeof(jit));
+    j->code = mmap(NULL, CODESIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (j->code == MAP_FAILED){
+        return Interp_prog_threaded(program, registers, pc, io);
+    }
+    emit_stubs(j);
+
+    Jit_state *state = &j->state;
+    state->program = program;
+    state->io = io;
+    state->jit = j;
+    state->table = Memseg_table(program);
+    for (int i = 0; i < 8; ++i){
+        state->r[i] = registers[i];
+    }
+    flush(j);
+
+    //enter(state, block) is the trampoline in the code buffer
+    void (*enter)(Jit_state *, void *);
+    memcpy(&enter, &j->enter, sizeof(enter));
+
+    Interp_status status;
+    uint32_t ctr = *pc;
+    while (1){
+        if (ctr >= state->length){
+            status = INTERP_FAULTED;
+            break;
+        }
+        void *block = state->entries[ctr];
+        if (block == NULL){
+            block = translate(j, ctr);
+        }
+        enter(state, block);
+        ctr = state->pc;
+
+        if (state->reason == EXIT_HALT){
+            status = INTERP_HALTED;
+            break;
+        }
+        if (state->reason == EXIT_FAULT){
+            status = state->fault;
+            break;
+        }
+        if (state->reason == EXIT_FAR){
+            if (!Memseg_load_prog(program, state->farSeg)){
+                ctr = state->farPc;
+                status = INTERP_MEMORY;
+                break;
+            }
+            state->table = Memseg_table(program);
+            flush(j);
+        }
+    }
+
+    for (int i = 0; i < 8; ++i){
+        registers[i] = state->r[i];
+    }
+    munmap(j->code, CODESIZE);
+    free(state->entries);
+    free(j->cover);
+    free(j->blocks);
+    *pc = ctr;
+    return status;
+}
+/*****************************************************************/
+#else
+extern Interp_status Interp_prog_jit(Memseg_T program, unsigned *registers, uint32_t *pc,
+                                    Umio_T io){
+    return Interp_prog_threaded(program, registers, pc, io);
+}
+#endif
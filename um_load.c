@@ -3,50 +3,196 @@
 
 /* An invariant while loading an on disk program is recognized
 in the Memset_T program variable which is a representation of the
-UM's memory space. At any point while reading an on-disk program
-this variable will contain a sequence of all of the previously
-read instruction words. This should be a checkable property at
-any point of input processing.*/ 
+UM's memory space. Once the image has been read, segment 0 of this
+variable holds every complete big-endian word of the image in host
+order, in file order. A trailing partial word is ignored.
+
+Regular files are memory-mapped and converted straight into the
+storage of segment 0, so no word passes through stdio. Pipes and
+terminals cannot be mapped; they are read in large blocks instead.*/
 
 /****************************************************************/
-#include"bitpack.h" //Bitpacking
+#define _POSIX_C_SOURCE 200809L //fileno, ftello, mmap, read
 #include"um_load.h" //Own header file
-#include"seq.h"     //Hanson's sequence used to represent memory
 #include<stdlib.h>  //Standard library
+#include<string.h>  //strerror
+#include<errno.h>   //Interrupted reads
+#include<limits.h>  //INT_MAX
+#include<unistd.h>  //read
+#include<sys/types.h>
+#include<sys/stat.h>//fstat
+#include<sys/mman.h>//mmap
+#if defined(__SSE2__)
+#include<immintrin.h>
+#endif
 
 #define BYTESIZE 8
 #define WORDSIZE 4
+#define BLOCKSIZE (1 << 20) //bytes asked of each read on a pipe
+#define MAXWORDS INT_MAX    //longest segment Memseg_map can make
+/****************************************************************/
+#if defined(__SSE2__)
+//Function swap_avx2 reverses the bytes of eight words per shuffle
+//and returns how many words it converted. It is built for AVX2
+//alone, as SSE2 is the most every x86-64 has.
+__attribute__((target("avx2")))
+static size_t swap_avx2(uint32_t *dst, const unsigned char *src, size_t n){
+    const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                           11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4,
+                                           11, 10, 9, 8, 15, 14, 13, 12);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * WORDSIZE));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(v, order));
+    }
+    return i;
+}
+//Function swap_sse2 swaps the halves of four words, then the bytes
+//of each half, and returns how many words it converted
+static size_t swap_sse2(uint32_t *dst, const unsigned char *src, size_t n){
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * WORDSIZE));
+        v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+        v = _mm_or_si128(_mm_slli_epi16(v, BYTESIZE), _mm_srli_epi16(v, BYTESIZE));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    return i;
+}
+#endif
+/****************************************************************/
+//Function swap_words converts 'n' big-endian words starting at
+//'src' into host order at 'dst', with AVX2 if the host has it.
+//The vector paths assume a little-endian host, which every x86
+//is; the scalar tail assembles the words a byte at a time like
+//the old getc loop.
+static void swap_words(uint32_t *dst, const unsigned char *src, size_t n){
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    i = __builtin_cpu_supports("avx2") ? swap_avx2(dst, src, n)
+                                       : swap_sse2(dst, src, n);
+#endif
+
+    for (; i < n; ++i){
+        const unsigned char *word = src + i * WORDSIZE;
+        dst[i] = ((uint32_t)word[0] << 24) | ((uint32_t)word[1] << 16) |
+                 ((uint32_t)word[2] << 8)  |  (uint32_t)word[3];
+    }
+}
+/****************************************************************/
+//Function install maps segment 0 of 'program' with room for every
+//complete word in the 'size' byte image at 'image', converts the
+//image into it and predecodes it. It returns NULL, or why the image
+//could not be loaded: more words than a segment can hold, or than
+//the host has memory for.
+static const char *install(Memseg_T program, const unsigned char *image, size_t size){
+    uint32_t length;
+    if (size / WORDSIZE > MAXWORDS){
+        return "is too large to load";
+    }
+    uint32_t location = Memseg_map(program, (int)(size / WORDSIZE));
+    if (location == MEMSEG_NONE){
+        return "does not fit in memory";
+    }
+
+    //A freshly mapped segment is not shared, so it can be filled
+    //in place rather than one Memseg_store at a time
+    uint32_t *words = Memseg_segment(program, location, &length);
+    swap_words(words, image, length);
+
+    //Unpack the program once so execution never has to
+    return Memseg_decode(program) ? NULL : "does not fit in memory";
+}
 /****************************************************************/
-extern Memseg_T Load_prog(FILE * fp){
+//Function check_install installs the image, exiting if it cannot
+static void check_install(Memseg_T program, const unsigned char *image, size_t size){
+    const char *problem = install(program, image, size);
+    if (problem != NULL){
+        fprintf(stderr, "Error, program of %zu bytes %s.\n", size, problem);
+        exit(1);
+    }
+}
+/****************************************************************/
+//Function load_mapped memory-maps the regular file behind 'fp' and
+//installs it from its current position. It returns 0 if the file
+//cannot be mapped.
+static int load_mapped(Memseg_T program, FILE *fp){
+    struct stat info;
+    int fd = fileno(fp);
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0){
+        return 0;
+    }
 
-    //GET THE FILE SIZE
-    //Find the end of the file
-    int a = ftell(fp);
-    fseek(fp, 0L, SEEK_END);
+    off_t start = ftello(fp);
+    if (start < 0 || start > info.st_size){
+        return 0;
+    }
 
-    //ftell returns number of bytes to end; divide by bytes in word
-    int size = ((ftell(fp))/WORDSIZE);
-    fseek(fp, a,SEEK_SET);//rewind to the front of the file
+    void *image = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED){
+        return 0;
+    }
+    posix_madvise(image, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
 
-    Memseg_T program = Memseg_init();
-    uint32_t location = Memseg_map(program, size);
+    check_install(program, (const unsigned char *)image + start, (size_t)(info.st_size - start));
+    munmap(image, (size_t)info.st_size);
+    return 1;
+}
+/****************************************************************/
+//Function load_stream reads everything left on the descriptor
+//behind 'fp' in large blocks and installs it.
+static void load_stream(Memseg_T program, FILE *fp){
+    int fd = fileno(fp);
+    size_t capacity = BLOCKSIZE, used = 0;
+    unsigned char *image = malloc(capacity);
+    if (image == NULL){
+        fprintf(stderr, "Error, out of memory reading program.\n");
+        exit(1);
+    }
 
-    //Iterate through all of the instructions in the passed in
-    //program, assembeling each word and inserting it into a
-    //Memory segment.
-    for (int wordCTR = 0; wordCTR < size; wordCTR++){
-        uint32_t last8 = getc(fp);
-        last8 = last8 << 24;
-        uint32_t midl8 = getc(fp);
-        midl8 = midl8 << 16;
-        uint32_t midf8 = getc(fp);
-        midf8 = midf8 << 8;
-        uint32_t first8 = getc(fp);
+    while (1){
+        ssize_t got = read(fd, image + used, capacity - used);
+        if (got == 0){
+            break;
+        }
+        if (got < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            fprintf(stderr, "Error reading program: %s.\n", strerror(errno));
+            exit(1);
+        }
 
-        uint32_t word = (((last8 | midl8) | midf8 ) | first8);
+        used += (size_t)got;
+        if (used == capacity){
+            capacity *= 2;
+            image = realloc(image, capacity);
+            if (image == NULL){
+                fprintf(stderr, "Error, out of memory reading program.\n");
+                exit(1);
+            }
+        }
+    }
+
+    check_install(program, image, used);
+    free(image);
+}
+/****************************************************************/
+extern void Load_prog(FILE * fp, Memseg_T program){
 
-        //Store the instruction(word) into the memory space
-        Memseg_store(program, word, location, wordCTR);
+    //Map regular files, read anything else
+    if (!load_mapped(program, fp)){
+        load_stream(program, fp);
     }
-    return program;
-}
\ No newline at end of file
+}
+/****************************************************************/
+extern void Load_image(const void *image, size_t size, Memseg_T program){
+    check_install(program, image, size);
+}
+/****************************************************************/
+extern int Load_try_image(const void *image, size_t size, Memseg_T program){
+    return install(program, image, size) == NULL;
+}
+/****************************************************************/
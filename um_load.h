@@ -4,6 +4,20 @@
 #include"um_mem.h"
 
 /* Load_prog takes in a file pointer to a UM program
-and loads that program into a memory space representation
-Memset_T. The memory space is then returned to the caller.*/
-extern Memseg_T Load_prog(FILE * fp);
\ No newline at end of file
+and loads that program into segment 0 of the empty memory
+space representation Memset_T 'program'. Nothing may have been read from 'fp' through stdio yet; the
+image is taken straight from its file descriptor, mapped if
+it is a regular file and read in blocks if it is a pipe.*/
+extern void Load_prog(FILE * fp, Memseg_T program);
+
+/* Load_image loads the 'size' byte program image at 'image', as it
+would be found on disk, into segment 0 of the empty memory space
+'program' in the same way, for callers that hold the image in
+memory already.*/
+extern void Load_image(const void *image, size_t size, Memseg_T program);
+
+/* Load_try_image does what Load_image does, but returns 0 instead of
+exiting when the image is too large for a segment or for the host's
+memory, and 1 once it is loaded. Whatever it loaded is left for the
+caller to free with 'program'.*/
+extern int Load_try_image(const void *image, size_t size, Memseg_T program);
@@ -0,0 +1,149 @@
+//Timothy Colaneri
+//Universal Machine library implementation
+
+/**********************************************************************/
+#include<stdlib.h>
+#include<string.h>
+#include"um_machine.h" //Own header
+#include"um_load.h"    //Load_try_image
+#include"um_exec.h"    //Engines
+/**********************************************************************/
+//A Machine_T holds one machine and what it takes to start it over.
+//image is the caller's program image, copied, for Machine_reset.
+//program, registers and pc are the state of the machine, and once
+//done is set, status is how its last run ended and fault how the
+//engine put it. read, write and cl
+//are the callbacks io was created with.
+#define T Machine_T
+struct T {
+    Interp_status (*interp)(Memseg_T, unsigned *, uint32_t *, Umio_T);
+    Memseg_alloc policy;
+    unsigned char *image;
+    size_t size;
+    Memseg_T program;
+    uint32_t registers[8];
+    uint32_t pc;
+    Umio_T io;
+    int done;
+    Machine_status status;
+    Interp_status fault;
+    Umio_read *read;
+    Umio_write *write;
+    void *cl;
+};
+/**********************************************************************/
+//Function start loads the image into a fresh memory space and clears
+//the registers. It returns 0 if the image could not be loaded, in
+//which case the machine is done, having faulted for want of memory.
+static int start(T machine){
+    machine->program = Memseg_new(machine->policy);
+    memset(machine->registers, 0, sizeof(machine->registers));
+    machine->pc = 0;
+    machine->done = 0;
+    machine->io = Umio_callbacks(machine->read, machine->write, machine->cl,
+                                 UMIO_THRESHOLD);
+    if (!Load_try_image(machine->image, machine->size, machine->program)){
+        machine->done = 1;
+        machine->status = MACHINE_FAULTED;
+        machine->fault = INTERP_MEMORY;
+        return 0;
+    }
+    return 1;
+}
+/**********************************************************************/
+//Function stop frees what start set up
+static void stop(T machine){
+    Umio_free(machine->io);
+    Memseg_free(machine->program);
+}
+/**********************************************************************/
+//Machine_new copies the image and starts the machine, unless
+//'engine' is none of the engines or there is no memory for it
+extern T Machine_new(const void *image, size_t size, Machine_engine engine,
+                     Memseg_alloc policy){
+    Interp_status (*interp)(Memseg_T, unsigned *, uint32_t *, Umio_T);
+    switch (engine){
+        case MACHINE_SWITCH:   interp = Interp_prog;          break;
+        case MACHINE_THREADED: interp = Interp_prog_threaded; break;
+        case MACHINE_JIT:      interp = Interp_prog_jit;      break;
+        case MACHINE_CHECKED:  interp = Interp_prog_checked;  break;
+        default:               return NULL;
+    }
+
+    T machine = malloc(sizeof(*machine));
+    if (machine == NULL){
+        return NULL;
+    }
+    machine->interp = interp;
+    machine->policy = policy;
+    //One spare byte keeps an empty image from asking for 0 bytes
+    machine->image = malloc(size + 1);
+    if (machine->image == NULL){
+        free(machine);
+        return NULL;
+    }
+    memcpy(machine->image, image, size);
+    machine->size = size;
+    machine->read = NULL;
+    machine->write = NULL;
+    machine->cl = NULL;
+    if (!start(machine)){
+        Machine_free(machine);
+        return NULL;
+    }
+    return machine;
+}
+/**********************************************************************/
+//Machine_io replaces the I/O state, which holds no input or output
+//between runs
+extern void Machine_io(T machine, Umio_read *read, Umio_write *write, void *cl){
+    machine->read = read;
+    machine->write = write;
+    machine->cl = cl;
+    Umio_free(machine->io);
+    machine->io = Umio_callbacks(read, write, cl, UMIO_THRESHOLD);
+}
+/**********************************************************************/
+//Machine_run runs the machine under its engine and passes on its
+//output before returning
+extern Machine_status Machine_run(T machine){
+    if (!machine->done){
+        machine->fault = machine->interp(machine->program, machine->registers,
+                                         &machine->pc, machine->io);
+        Umio_flush(machine->io);
+        machine->status = machine->fault == INTERP_HALTED ? MACHINE_HALTED
+                                                          : MACHINE_FAULTED;
+        machine->done = 1;
+    }
+    return machine->status;
+}
+/**********************************************************************/
+//Machine_reset starts the machine over from its copy of the image,
+//which start leaves faulted if it no longer fits
+extern void Machine_reset(T machine){
+    stop(machine);
+    start(machine);
+}
+/**********************************************************************/
+//Machine_fault passes on the engine's description of the fault
+extern const char *Machine_fault(T machine){
+    return Interp_fault(machine->fault);
+}
+/**********************************************************************/
+//Machine_pc returns the PC of the machine
+extern uint32_t Machine_pc(T machine){
+    return machine->pc;
+}
+/**********************************************************************/
+//Machine_registers returns the registers of the machine
+extern const uint32_t *Machine_registers(T machine){
+    return machine->registers;
+}
+/**********************************************************************/
+//Machine_free stops the machine and frees it
+extern void Machine_free(T machine){
+    stop(machine);
+    free(machine->image);
+    free(machine);
+}
+/**********************************************************************/
@@ -0,0 +1,75 @@
+//Timothy Colaneri
+//Universal Machine library interface
+
+/* A Machine_T is one universal machine behind an opaque handle, for
+programs that run UM jobs without a process of their own for each.
+It never prints or touches stdin and stdout unless the caller's
+callbacks do, and any number of machines may be run, one call at a
+time each, from the same process.
+
+How safe a bad program is for the host depends on the engine. Under
+MACHINE_CHECKED every fault of the program ends only its own run.
+Every engine reports as a fault an unmap of segment 0 or of a segment
+that is not mapped, and a map, store or load program the host has no
+memory for. The other engines trust the program otherwise: a division
+by zero or an access outside of a segment raises SIGFPE or SIGSEGV in
+the host process, and so ends every machine in it. */
+
+/**********************************************************************/
+#ifndef MACHINE_INCLUDED
+#define MACHINE_INCLUDED
+#include <inttypes.h>
+#include <stddef.h>
+#include "um_mem.h"
+#include "um_io.h"
+#define T Machine_T
+typedef struct T *T;
+/**********************************************************************/
+//A Machine_engine names the interpreter a machine runs under, as
+//--engine does for um
+typedef enum Machine_engine {
+    MACHINE_SWITCH, MACHINE_THREADED, MACHINE_JIT, MACHINE_CHECKED
+} Machine_engine;
+//A Machine_status tells how Machine_run returned. MACHINE_HALTED
+//is a halt instruction and MACHINE_FAULTED a fault, which
+//Machine_fault describes and whose PC Machine_pc gives. Only
+//MACHINE_CHECKED catches every fault; the other engines only
+//catch a jump outside of segment 0, a bad unmap and running out
+//of memory.
+typedef enum Machine_status {
+    MACHINE_HALTED, MACHINE_FAULTED
+} Machine_status;
+/**********************************************************************/
+extern T Machine_new(const void *image, size_t size, Machine_engine engine,
+                     Memseg_alloc policy);
+//Machine_new creates a machine with the 'size' byte program image at
+//'image', in the form um reads from disk, loaded into segment 0 and
+//every register 0. It keeps its own copy of the image for
+//Machine_reset. The machine has no input and discards its output
+//until Machine_io is called. It returns NULL if 'engine' is not one
+//of the Machine_engine values, or if the image is too large for a
+//segment or there is no memory for the machine.
+extern void Machine_io(T machine, Umio_read *read, Umio_write *write, void *cl);
+//Machine_io sends the input and output instructions of 'machine' to
+//'read' and 'write', either of which may be NULL, passing them 'cl'.
+//Output reaches 'write' in blocks, and all of it before Machine_run
+//returns or an input instruction waits on 'read'.
+extern Machine_status Machine_run(T machine);
+//Machine_run runs 'machine' until it halts or faults. Running it
+//again without a Machine_reset returns the same status at once.
+extern void Machine_reset(T machine);
+//Machine_reset puts 'machine' back as Machine_new left it, keeping
+//its callbacks, so the same program can be run as another job. If
+//there is no longer memory for the image, the machine is left done,
+//faulted for want of memory, and Machine_run returns MACHINE_FAULTED.
+extern const char *Machine_fault(T machine);
+//Machine_fault describes the fault 'machine' stopped on
+extern uint32_t Machine_pc(T machine);
+//Machine_pc returns the PC 'machine' halted or faulted at
+extern const uint32_t *Machine_registers(T machine);
+//Machine_registers returns the eight registers of 'machine'
+extern void Machine_free(T machine);
+//Machine_free frees 'machine' and everything it holds
+/**********************************************************************/
+#undef T
+#endif
@@ -2,65 +2,611 @@
 //Universal Machine Memory Segment Implementation
 
 /**********************************************************/
+#define _DEFAULT_SOURCE     //MAP_ANONYMOUS, madvise
 #include<stdlib.h>
 #include<stdio.h>   //Output/input instructions
-#include"stack.h"   //Used to handle unmapped segments
-#include<seq.h>     //Used to represent memory segment
-#include<array.h>   //
+#include<string.h>  //memcpy for duplicated segments
+#include<stddef.h>  //offsetof
 #include<assert.h>  //Assertions
+#include<sys/mman.h>//Restored images, large segments
 #include"um_mem.h"  //Own header
+#include"um_fuse.h" //Length of superinstructions
+#include"um_footprint.h" //Footprint samples
+/**********************************************************/
+//A Segment is one universal machine memory segment. Its
+//length lives in a header right in front of its words, so
+//reaching a word takes a single pointer from the table.
+//A Segment may be shared by several IDs after a load
+//program; refs counts them, and the first store through
+//any of them gives that ID a private copy. A Segment that
+//has served as segment 0 also carries its predecoded code,
+//which travels with it for as long as it is shared.
+//While a Segment waits on a free list for reuse, next links
+//it to the following one in place of its code.
+typedef struct Segment {
+    uint32_t length;
+    uint32_t refs;
+    union {
+        Codeword *code;
+        struct Segment *next;
+    } u;
+    uint32_t words[];
+} Segment;
+/**********************************************************/
+//A Mapping heads the anonymous mapping of a large segment,
+//which follows it, and links it to the other large segments
+//mapped in the same memory space.
+typedef struct Mapping {
+    struct Mapping *prev, *next;
+} Mapping;
+/**********************************************************/
+//A Chunk is one block of an arena, handed out to segments
+//from front to back and only ever freed as a whole.
+typedef struct Chunk {
+    struct Chunk *next;
+    size_t size;
+    unsigned char space[];
+} Chunk;
+
+#define CLASSES 256         //segments shorter than this are recycled
+#define CHUNKSIZE (1 << 20) //bytes in an ordinary arena chunk
+#define ALIGNMENT 16        //keeps the table flags free in pointers
+#define LARGE (1 << 16)     //segments this long or longer are mapped
+#define PAGE 4096           //bytes in a page
+#define HUGE (2u << 20)     //bytes in a transparent huge page
+#define SPARES 4            //large mappings kept for reuse
 /**********************************************************/
 //A Memseg_T structure is a representation of a universal
-//machine memory segment. The sequence segemnts holds each
-//segmented piece of the memory. The Queue unmapped will
-//contain a list of each memory space which has been 
-//released and is availible for reuse.
-//At any point in execution of a program, the Memseg_T's
-//segments sequence will contain all memory segments
+//machine memory space. The table segments holds a pointer
+//to each segmented piece of the memory, indexed by segment
+//ID, with 0 marking an unmapped ID. The vector unmapped
+//will contain a list of each ID which has been released
+//and is availible for reuse.
+//At any point in execution of a program, segments[0] to
+//segments[count - 1] will contain all memory segments
 //currently stored in the program
-//At any point in execution of a program, the unmapped
-//stack will contain a list of all of the memory spaces
-//which have been unmapped and not reused.
+//At any point in execution of a program, unmapped[0] to
+//unmapped[unmappedCount - 1] will contain all of the IDs
+//which have been unmapped and not reused, the most recently
+//unmapped last.
+//The low bits of a table entry flag segments that need more
+//than a plain store: SHARED is set on every ID of a segment
+//whose refs is above 1, and DECODED on every ID of a segment
+//that carries predecoded code. A store through an entry with
+//neither flag never has to look at the segment's header.
+//SHARED may outlive the sharing, and is cleared by the next
+//store through that ID.
+//Once predecoding is enabled, segment 0's code holds one
+//Codeword for each of its words, and code[i] is either the
+//decoded form of word i or marked DECODE_STALE.
+//Unless the policy is MEMSEG_MALLOC, freeLists[n] links the
+//freed segments of n words that are waiting to be reused.
+//Under MEMSEG_ARENA every code array and every segment short
+//of LARGE words is carved out of the chunks list, the
+//current chunk's unused space running from bump to limit,
+//and nothing is freed until Memseg_free releases the chunks.
+//stats.copiesAvoided counts load programs that shared a
+//segment instead of copying it, stats.copiesMade the copies
+//that a later store forced after all. stats.bytesHeld counts
+//the bytes on the free lists and, in an arena, the bytes of
+//abandoned blocks; the unused end of the current chunk is
+//added when the stats are read. The footprint counters
+//are kept up to date as segments and host memory come and
+//go, apart from those Memseg_get_stats works out: segments
+//and freeIds from the table and the unmapped list, maps
+//from the sizes, and unmaps from those.
+//A memory space restored by Memseg_restore keeps its
+//segments where they lie in the image, which runs from image
+//for imageSize bytes and is unmapped by Memseg_free. Those
+//segments are never given to free.
+//Whatever the policy, a segment of LARGE words or more has
+//an anonymous mapping of its own, whose pages the kernel
+//zeroes as they are first touched, so mapping it costs no
+//zero fill. Unmapping it gives its pages back at once. The
+//last SPARES such mappings unmapped are kept, emptied with
+//MADV_DONTNEED, in spares[0] to spares[spareCount - 1], of
+//spareBytes bytes each, for a segment needing as many. The
+//mappings of large segments still in use are linked from
+//mappings, so Memseg_free unmaps them without visiting the
+//others.
 #define T Memseg_T
 struct T {
-    Seq_T segments;
-    Stack_T unmapped;
+    uintptr_t *segments;
+    uint32_t count, capacity;
+    uint32_t *unmapped;
+    uint32_t unmappedCount, unmappedCapacity;
+    int decoding;
+    Memseg_alloc policy;
+    Segment *freeLists[CLASSES];
+    Chunk *chunks;
+    unsigned char *bump, *limit;
+    unsigned char *image;
+    size_t imageSize;
+    Mapping *mappings;
+    Mapping *spares[SPARES];
+    size_t spareBytes[SPARES];
+    unsigned spareCount;
+    Memseg_stats stats;
 };
+
+#define SHARED  ((uintptr_t)1)
+#define DECODED ((uintptr_t)2)
+#define FLAGS   (SHARED | DECODED)
+
+//Generated code relies on the layout published in um_mem.h
+typedef char check_flags[FLAGS == MEMSEG_FLAGS ? 1 : -1];
+typedef char check_words[offsetof(Segment, words) == MEMSEG_WORDS ? 1 : -1];
+/**********************************************************/
+//Function segment_at returns the segment found in the table
+//of 'memSpace' at 'seg', without its flags.
+static inline Segment *segment_at(T memSpace, uint32_t seg){
+    return (Segment *)(memSpace->segments[seg] & ~FLAGS);
+}
+/**********************************************************/
+//Function in_image tells whether 'segment' lies in the image
+//'memSpace' was restored from.
+static inline int in_image(T memSpace, Segment *segment){
+    unsigned char *at = (unsigned char *)segment;
+    return at >= memSpace->image && at < memSpace->image + memSpace->imageSize;
+}
+/**********************************************************/
+//Function entry_for returns the table entry for 'segment',
+//flagged according to its current state.
+static inline uintptr_t entry_for(Segment *segment){
+    uintptr_t entry = (uintptr_t)segment;
+    if (segment->refs > 1){
+        entry |= SHARED;
+    }
+    if (segment->u.code != NULL){
+        entry |= DECODED;
+    }
+    return entry;
+}
+/**********************************************************/
+//Function segment_bytes returns the number of bytes taken
+//by a segment of 'size' words.
+static inline size_t segment_bytes(uint32_t size){
+    return sizeof(Segment) + (size_t)size * sizeof(uint32_t);
+}
+/**********************************************************/
+//Function malloc_bytes estimates the bytes malloc takes for
+//a block of 'bytes': glibc adds an 8 byte header and rounds
+//up to 16, with 32 at the least.
+static inline size_t malloc_bytes(size_t bytes){
+    size_t total = (bytes + 8 + 15) & ~(size_t)15;
+    return total < 32 ? 32 : total;
+}
+/**********************************************************/
+//Functions host_take and host_give count 'bytes' that the
+//memory space takes from the host or gives back, keeping the
+//high water mark
+static inline void host_take(T memSpace, size_t bytes){
+    memSpace->stats.hostBytes += bytes;
+    if (memSpace->stats.hostBytes > memSpace->stats.peakHostBytes){
+        memSpace->stats.peakHostBytes = memSpace->stats.hostBytes;
+    }
+}
+static inline void host_give(T memSpace, size_t bytes){
+    memSpace->stats.hostBytes -= bytes;
+}
+/**********************************************************/
+//Function bucket returns the bucket of sizes that a segment
+//of 'size' words counts in: the number of bits 'size' takes
+static inline unsigned bucket(uint32_t size){
+#if defined(__GNUC__)
+    return size == 0 ? 0 : 32 - (unsigned)__builtin_clz(size);
+#else
+    unsigned bits = 0;
+    for (; size != 0; size >>= 1){
+        ++bits;
+    }
+    return bits;
+#endif
+}
+/**********************************************************/
+//Functions live_add and live_remove count 'size' words of
+//an ID coming into or going out of use. The mapped IDs are
+//count less unmappedCount, so only their high water mark is
+//kept here.
+static inline void live_add(T memSpace, uint32_t size){
+    Memseg_stats *stats = &memSpace->stats;
+    stats->words += size;
+    if (stats->words > stats->peakWords){
+        stats->peakWords = stats->words;
+    }
+    if (memSpace->count - memSpace->unmappedCount > stats->peakSegments){
+        stats->peakSegments = memSpace->count - memSpace->unmappedCount;
+    }
+}
+static inline void live_remove(T memSpace, uint32_t size){
+    memSpace->stats.words -= size;
+}
+/**********************************************************/
+//Function take_footprint hands the counters to
+//Footprint_take. It is kept out of line, so the copy of the
+//counters stays out of the frames of map and unmap.
+static void take_footprint(T memSpace){
+    Memseg_stats stats;
+    Memseg_get_stats(memSpace, &stats);
+    Footprint_take(&stats);
+}
+//Function footprint takes a footprint sample once one is due.
+//It is called where the footprint changes, on map, unmap and
+//load program.
+static inline void footprint(T memSpace){
+    if (Footprint_due){
+        take_footprint(memSpace);
+    }
+}
+/**********************************************************/
+//Function map_bytes returns the bytes mapped for a large
+//segment of 'size' words and its Mapping: whole pages, or
+//whole huge pages once they fill one.
+static inline size_t map_bytes(uint32_t size){
+    size_t bytes = sizeof(Mapping) + segment_bytes(size);
+    size_t unit = bytes >= HUGE ? HUGE : PAGE;
+    return (bytes + unit - 1) & ~(unit - 1);
+}
+/**********************************************************/
+//Function map_new makes an anonymous mapping of 'bytes' bytes
+//for a large segment. A mapping of huge pages
+//is made a huge page longer than it needs, so it can be
+//trimmed to start on a huge page boundary, and is offered to
+//the kernel for transparent huge pages. It returns NULL if the
+//host has no room for the mapping.
+static Mapping *map_new(size_t bytes){
+    size_t extra = bytes >= HUGE ? HUGE : 0;
+    unsigned char *at = mmap(NULL, bytes + extra, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (at == MAP_FAILED){
+        return NULL;
+    }
+    if (extra > 0){
+        size_t lead = (HUGE - (uintptr_t)at % HUGE) % HUGE;
+        if (lead > 0){
+            munmap(at, lead);
+        }
+        munmap(at + lead + bytes, extra - lead);
+        at += lead;
+#if defined(MADV_HUGEPAGE)
+        madvise(at, bytes, MADV_HUGEPAGE);
+#endif
+    }
+    return (Mapping *)at;
+}
+/**********************************************************/
+//Function map_large returns a zero filled mapping for a
+//large segment of 'size' words, reusing a spare of the same
+//size if there is one, and puts it on the list of those in
+//use. It returns NULL if no mapping can be made.
+static Segment *map_large(T memSpace, uint32_t size){
+    size_t bytes = map_bytes(size);
+    Mapping *mapping = NULL;
+
+    for (unsigned i = 0; i < memSpace->spareCount; ++i){
+        if (memSpace->spareBytes[i] == bytes){
+            mapping = memSpace->spares[i];
+            --memSpace->spareCount;
+            memSpace->spares[i] = memSpace->spares[memSpace->spareCount];
+            memSpace->spareBytes[i] = memSpace->spareBytes[memSpace->spareCount];
+            ++memSpace->stats.allocHits;
+            break;
+        }
+    }
+    if (mapping == NULL){
+        ++memSpace->stats.allocMisses;
+        mapping = map_new(bytes);
+        if (mapping == NULL){
+            return NULL;
+        }
+    }
+
+    host_take(memSpace, bytes);
+    mapping->prev = NULL;
+    mapping->next = memSpace->mappings;
+    if (mapping->next != NULL){
+        mapping->next->prev = mapping;
+    }
+    memSpace->mappings = mapping;
+    return (Segment *)(mapping + 1);
+}
+/**********************************************************/
+//Function unmap_large gives the pages of a large 'segment'
+//back, keeping its mapping as a spare while there is room.
+static void unmap_large(T memSpace, Segment *segment){
+    Mapping *mapping = (Mapping *)segment - 1;
+    size_t bytes = map_bytes(segment->length);
+    host_give(memSpace, bytes);
+
+    if (mapping->prev != NULL){
+        mapping->prev->next = mapping->next;
+    }
+    else{
+        memSpace->mappings = mapping->next;
+    }
+    if (mapping->next != NULL){
+        mapping->next->prev = mapping->prev;
+    }
+
+    if (memSpace->spareCount < SPARES){
+        madvise(mapping, bytes, MADV_DONTNEED);
+        memSpace->spares[memSpace->spareCount] = mapping;
+        memSpace->spareBytes[memSpace->spareCount++] = bytes;
+    }
+    else{
+        munmap(mapping, bytes);
+    }
+}
+/**********************************************************/
+//Function arena_alloc carves 'bytes' bytes out of the arena
+//of 'memSpace', starting a new chunk when the current one is
+//too full. A request too big for an ordinary chunk gets a
+//chunk of its own. It returns NULL if the host has no room
+//for a new chunk.
+static void *arena_alloc(T memSpace, size_t bytes){
+    bytes = (bytes + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+
+    if ((size_t)(memSpace->limit - memSpace->bump) < bytes){
+        int ownChunk = bytes > CHUNKSIZE / 4;
+        size_t size = ownChunk ? bytes : CHUNKSIZE;
+        Chunk *chunk = malloc(sizeof(Chunk) + size);
+        if (chunk == NULL){
+            return NULL;
+        }
+        host_take(memSpace, malloc_bytes(sizeof(Chunk) + size));
+        chunk->size = size;
+        chunk->next = memSpace->chunks;
+        memSpace->chunks = chunk;
+        if (ownChunk){
+            return chunk->space;
+        }
+
+        //What is left of the old chunk is lost to reuse
+        memSpace->stats.bytesHeld += (size_t)(memSpace->limit - memSpace->bump);
+        memSpace->bump = chunk->space;
+        memSpace->limit = chunk->space + size;
+    }
+
+    void *block = memSpace->bump;
+    memSpace->bump += bytes;
+    return block;
+}
+/**********************************************************/
+//Function alloc_segment returns room for a segment of 'size'
+//words, its contents undefined. Short segments come off
+//their size's free list when one is waiting there, and
+//large ones are mapped. It returns NULL if the host is out
+//of memory.
+static inline Segment *alloc_segment(T memSpace, uint32_t size){
+    Segment *segment;
+
+    if (size >= LARGE){
+        return map_large(memSpace, size);
+    }
+    if (size < CLASSES && memSpace->freeLists[size] != NULL){
+        segment = memSpace->freeLists[size];
+        memSpace->freeLists[size] = segment->u.next;
+        memSpace->stats.bytesHeld -= segment_bytes(size);
+        ++memSpace->stats.allocHits;
+        return segment;
+    }
+
+    ++memSpace->stats.allocMisses;
+    if (memSpace->policy == MEMSEG_ARENA){
+        segment = arena_alloc(memSpace, segment_bytes(size));
+    }
+    else{
+        segment = malloc(segment_bytes(size));
+        if (segment != NULL){
+            host_take(memSpace, malloc_bytes(segment_bytes(size)));
+        }
+    }
+    return segment;
+}
+/**********************************************************/
+//Function free_segment gives the space of 'segment' back.
+//Short segments wait on their size's free list; large ones
+//are unmapped; others go back to malloc, or in an arena or
+//a restored image are abandoned until Memseg_free.
+static inline void free_segment(T memSpace, Segment *segment){
+    uint32_t size = segment->length;
+
+    if (size >= LARGE && !in_image(memSpace, segment)){
+        unmap_large(memSpace, segment);
+    }
+    else if (memSpace->policy != MEMSEG_MALLOC && size < CLASSES){
+        segment->u.next = memSpace->freeLists[size];
+        memSpace->freeLists[size] = segment;
+        memSpace->stats.bytesHeld += segment_bytes(size);
+    }
+    else if (memSpace->policy == MEMSEG_ARENA || in_image(memSpace, segment)){
+        memSpace->stats.bytesHeld += segment_bytes(size);
+    }
+    else{
+        host_give(memSpace, malloc_bytes(segment_bytes(size)));
+        free(segment);
+    }
+}
+/**********************************************************/
+//Function new_segment allocates a zero filled segment of
+//'size' words, or returns NULL if there is no room for it.
+//A large segment is mapped already zeroed.
+static inline Segment *new_segment(T memSpace, uint32_t size){
+    Segment *segment = alloc_segment(memSpace, size);
+    if (segment == NULL){
+        return NULL;
+    }
+    memset(segment, 0, size < LARGE ? segment_bytes(size) : sizeof(Segment));
+    segment->length = size;
+    segment->refs = 1;
+    return segment;
+}
+/**********************************************************/
+//Function release_segment drops one reference to 'segment'
+//and frees it once no ID refers to it any more.
+static inline void release_segment(T memSpace, Segment *segment){
+    if (segment != NULL && --segment->refs == 0){
+        if (segment->u.code != NULL){
+            if (memSpace->policy == MEMSEG_ARENA ||
+                in_image(memSpace, (Segment *)segment->u.code)){
+                memSpace->stats.bytesHeld += (segment->length + 1) * sizeof(Codeword);
+            }
+            else{
+                host_give(memSpace, malloc_bytes((segment->length + 1) * sizeof(Codeword)));
+                free(segment->u.code);
+            }
+        }
+        free_segment(memSpace, segment);
+    }
+}
+/**********************************************************/
+//Function private_segment gives the ID 'seg' its own copy of
+//a segment it shares with other IDs, so that it can be
+//written without the others seeing the change. When the
+//writer is segment 0 it keeps the original, along with the
+//predecoded code the interpreter is holding on to, and the
+//other IDs move over to the copy instead. If the other IDs
+//have already let go of the segment there is nothing to
+//copy, and only the flag is cleared. It returns NULL, with
+//nothing changed, if there is no memory for the copy.
+static Segment *private_segment(T memSpace, uint32_t seg){
+    Segment *shared = segment_at(memSpace, seg);
+    if (shared->refs == 1){
+        memSpace->segments[seg] = entry_for(shared);
+        return shared;
+    }
+
+    Segment *copy = alloc_segment(memSpace, shared->length);
+    if (copy == NULL){
+        return NULL;
+    }
+    memcpy(copy, shared, segment_bytes(shared->length));
+    copy->u.code = NULL;
+    ++memSpace->stats.copiesMade;
+    memSpace->stats.bytesCopied += (uint64_t)shared->length * sizeof(uint32_t);
+
+    if (seg == 0){
+        copy->refs = shared->refs - 1;
+        shared->refs = 1;
+        for (uint32_t i = 1; i < memSpace->count; ++i){
+            if (segment_at(memSpace, i) == shared){
+                memSpace->segments[i] = entry_for(copy);
+            }
+        }
+        memSpace->segments[0] = entry_for(shared);
+        return shared;
+    }
+
+    copy->refs = 1;
+    --shared->refs;
+    memSpace->segments[seg] = entry_for(copy);
+    return copy;
+}
 /**********************************************************/
 //Memseg_init creates a new Memseg_T memory segment,
 //initializes all of its values to empty, and returns the
 //new memory segment.
 extern T Memseg_init(){
+    return Memseg_new(MEMSEG_SLAB);
+}
+/**********************************************************/
+//Memseg_new creates an empty Memseg_T memory segment whose
+//segments are allocated under 'policy'.
+extern T Memseg_new(Memseg_alloc policy){
 
     //Create the new memory space
     T memSpace = malloc(sizeof(*memSpace));
     assert(memSpace);
 
-    //Initialize the memory structs members  
-    memSpace->segments = Seq_new(16);
-    memSpace->unmapped = Stack_new();
+    //Initialize the memory structs members
+    memSpace->count = 0;
+    memSpace->capacity = 16;
+    memSpace->segments = malloc(memSpace->capacity * sizeof(uintptr_t));
+    memSpace->unmappedCount = 0;
+    memSpace->unmappedCapacity = 16;
+    memSpace->unmapped = malloc(memSpace->unmappedCapacity * sizeof(uint32_t));
+    memSpace->decoding = 0;
+    memSpace->policy = policy;
+    memset(memSpace->freeLists, 0, sizeof(memSpace->freeLists));
+    memSpace->chunks = NULL;
+    memSpace->bump = memSpace->limit = NULL;
+    memSpace->image = NULL;
+    memSpace->imageSize = 0;
+    memSpace->mappings = NULL;
+    memSpace->spareCount = 0;
+    memset(&memSpace->stats, 0, sizeof(memSpace->stats));
 
     //Assert that the memory space was availible
     assert(memSpace->segments);
-    assert(memSpace->unmapped);    
+    assert(memSpace->unmapped);
+    host_take(memSpace, malloc_bytes(sizeof(*memSpace)) +
+              malloc_bytes(memSpace->capacity * sizeof(uintptr_t)) +
+              malloc_bytes(memSpace->unmappedCapacity * sizeof(uint32_t)));
     return memSpace;
 }
 /**********************************************************/
 //Memseg_store stores a new value 'elem' into the memory segment
 //located at 'seg'. It is placed into this word(memory segment)
-// at offset 'offset' 
-extern void Memseg_store(T memSpace,uint32_t elem,int seg, int offset){
-    Array_T memSeg = Seq_get(memSpace->segments,seg);
-    uint32_t * val = (uint32_t*)Array_get(memSeg,offset);
-    *val = elem;
+// at offset 'offset'
+extern int Memseg_store(T memSpace,uint32_t elem,int seg, int offset){
+    uintptr_t entry = memSpace->segments[(uint32_t)seg];
+    Segment *segment = (Segment *)(entry & ~FLAGS);
+
+    if (entry & FLAGS){
+
+        //A shared segment is copied on its first write
+        if (entry & SHARED){
+            segment = private_segment(memSpace, (uint32_t)seg);
+            if (segment == NULL){
+                return 0;
+            }
+        }
+
+        //Keep the predecoded program in step with self-modifying
+        //code. Programs also use segment 0 as plain data, so the
+        //word is only decoded again if it is ever executed. A
+        //superinstruction just before it that covers the word
+        //goes stale as well.
+        if (segment->u.code != NULL){
+            Codeword *code = segment->u.code;
+            uint32_t word = (uint32_t)offset;
+            code[word].opcode = DECODE_STALE;
+            for (uint32_t back = 1; back < FUSE_SPAN && back <= word; ++back){
+                if (code[word - back].opcode >= DECODE_FUSED){
+                    code[word - back].opcode = DECODE_STALE;
+                }
+            }
+        }
+    }
+    segment->words[(uint32_t)offset] = elem;
+    return 1;
 }
 /**********************************************************/
 //Memseg_load loads a value from the memory space 'memSpace'
-//found in the segment 'seg' at offset 'offset'. This 
+//found in the segment 'seg' at offset 'offset'. This
 //function then returns that value
 extern uint32_t Memseg_load(T memSpace,int seg,int offset){
-    Array_T memSeg = Seq_get(memSpace->segments,seg);
-    return *(uint32_t*)Array_get(memSeg,offset);
+    return segment_at(memSpace, (uint32_t)seg)->words[(uint32_t)offset];
+}
+/**********************************************************/
+//Function grow_table doubles the segment table of 'memSpace'.
+//It returns 0, leaving the table as it was, if the host has
+//no room for a bigger one or the IDs would run into
+//MEMSEG_NONE.
+static int grow_table(T memSpace){
+    if (memSpace->capacity > MEMSEG_NONE / 2){
+        return 0;
+    }
+    uint32_t capacity = memSpace->capacity * 2;
+    uintptr_t *segments = realloc(memSpace->segments, capacity * sizeof(uintptr_t));
+    if (segments == NULL){
+        return 0;
+    }
+    host_give(memSpace, malloc_bytes(memSpace->capacity * sizeof(uintptr_t)));
+    host_take(memSpace, malloc_bytes(capacity * sizeof(uintptr_t)));
+    memSpace->segments = segments;
+    memSpace->capacity = capacity;
+    return 1;
 }
 /**********************************************************/
 //Memseg_map creates a new segment with a number of words
@@ -68,64 +614,409 @@ extern uint32_t Memseg_load(T memSpace,int seg,int offset){
 //returned from the function
 extern uint32_t Memseg_map(T memSpace, int size){
 
-    Array_T newSeg = Array_new(size,sizeof(uint32_t));
-
-    assert(newSeg);
+    //The table grows first, so that running out of memory
+    //leaves nothing to undo
+    if (memSpace->unmappedCount == 0 && memSpace->count == memSpace->capacity &&
+        !grow_table(memSpace)){
+        return MEMSEG_NONE;
+    }
+    footprint(memSpace);
+    Segment *newSeg = new_segment(memSpace, (uint32_t)size);
+    if (newSeg == NULL){
+        return MEMSEG_NONE;
+    }
+    ++memSpace->stats.sizes[bucket((uint32_t)size)];
 
     //Determine if any memory spaces have been previously
     //freed, if so use the freed up memory space
     //else, add a new memory space
-    if (Stack_empty(memSpace->unmapped)){
-
-        Seq_addhi(memSpace->segments, (void*)newSeg);
-        return (uint32_t)((Seq_length(memSpace->segments)-1));
+    if (memSpace->unmappedCount == 0){
+        memSpace->segments[memSpace->count++] = (uintptr_t)newSeg;
+        live_add(memSpace, (uint32_t)size);
+        return memSpace->count - 1;
     }
     else{
 
-        uint64_t index = (uint64_t)(uint32_t*)Stack_pop(memSpace->unmapped);
-        Seq_put(memSpace->segments, index, (void*)newSeg);
-        return (uint32_t)index;
+        uint32_t index = memSpace->unmapped[--memSpace->unmappedCount];
+        memSpace->segments[index] = (uintptr_t)newSeg;
+        live_add(memSpace, (uint32_t)size);
+        return index;
     }
 }
 /**********************************************************/
 //Memseg_unmap unmaps the memery segment 'seg' found in the
-//memory space memSpace.
-extern void Memseg_unmap(T memSpace, uint32_t seg){
-    Array_T oldSeg = Seq_put(memSpace->segments,seg,NULL);
-    Array_free(&oldSeg);
-    Stack_push(memSpace->unmapped,(void*)(uint64_t)seg);
+//memory space memSpace. An ID the unmapped list has no room
+//for is simply never handed out again.
+extern int Memseg_unmap(T memSpace, uint32_t seg){
+    if (seg == 0 || seg >= memSpace->count || memSpace->segments[seg] == 0){
+        return 0;
+    }
+    footprint(memSpace);
+    Segment *segment = segment_at(memSpace, seg);
+    live_remove(memSpace, segment->length);
+    release_segment(memSpace, segment);
+    memSpace->segments[seg] = 0;
+
+    if (memSpace->unmappedCount == memSpace->unmappedCapacity){
+        uint32_t capacity = memSpace->unmappedCapacity * 2;
+        uint32_t *unmapped = realloc(memSpace->unmapped, capacity * sizeof(uint32_t));
+        if (unmapped == NULL){
+            return 1;
+        }
+        host_give(memSpace, malloc_bytes(memSpace->unmappedCapacity * sizeof(uint32_t)));
+        host_take(memSpace, malloc_bytes(capacity * sizeof(uint32_t)));
+        memSpace->unmapped = unmapped;
+        memSpace->unmappedCapacity = capacity;
+    }
+    memSpace->unmapped[memSpace->unmappedCount++] = seg;
+    if (memSpace->unmappedCount > memSpace->stats.peakFreeIds){
+        memSpace->stats.peakFreeIds = memSpace->unmappedCount;
+    }
+    return 1;
+}
+/**********************************************************/
+//Function decode builds the predecoded copy of 'segment' for
+//when it serves as segment 0. A segment that was decoded the
+//last time it did keeps its code, so it is not decoded again.
+//It returns 0 if there is no memory for the code.
+static int decode(T memSpace, Segment *segment){
+    if (segment->u.code != NULL){
+        return 1;
+    }
+
+    //One spare entry keeps an empty segment 0 from asking for 0 bytes
+    size_t bytes = (segment->length + 1) * sizeof(Codeword);
+    Codeword *code;
+    if (memSpace->policy == MEMSEG_ARENA){
+        code = arena_alloc(memSpace, bytes);
+    }
+    else{
+        code = malloc(bytes);
+        if (code != NULL){
+            host_take(memSpace, malloc_bytes(bytes));
+        }
+    }
+    if (code == NULL){
+        return 0;
+    }
+    Decode_words(segment->words, code, segment->length);
+    Decode_fuse(code, segment->length);
+    segment->u.code = code;
+    return 1;
 }
 /**********************************************************/
 //Memseg_load_prog duplicates the memory segment found in
-//'memSpace' at 'seg'. This segment is then loaded into 
+//'memSpace' at 'seg'. This segment is then loaded into
 //'memSpace' at postion 0, and the former code at postion 0
-//is abandoned.
-extern void Memseg_load_prog(T memSpace,int seg){
-    Array_T segment = Seq_get(memSpace->segments, seg);
-    Array_T newSeg = Array_copy(segment,Array_length(segment));
-    Array_T oldSeg = Seq_put(memSpace->segments,0,newSeg);
-    Array_free(&oldSeg);
+//is abandoned. The duplicate shares its words with 'seg'
+//until either ID is written, so a far jump costs nothing
+//more than a reference count. The segment is decoded first,
+//so running out of memory for its code changes nothing.
+extern int Memseg_load_prog(T memSpace,int seg){
+    Segment *segment = segment_at(memSpace, (uint32_t)seg);
+    Segment *oldSeg = segment_at(memSpace, 0);
+    assert(segment);
+    if (segment == oldSeg){
+        return 1;
+    }
+    if (memSpace->decoding && !decode(memSpace, segment)){
+        return 0;
+    }
+    footprint(memSpace);
+    live_remove(memSpace, oldSeg->length);
+    live_add(memSpace, segment->length);
+
+    ++segment->refs;
+    release_segment(memSpace, oldSeg);
+    ++memSpace->stats.copiesAvoided;
+
+    //Both IDs are now flagged as sharing the segment
+    memSpace->segments[0] = entry_for(segment);
+    memSpace->segments[(uint32_t)seg] = entry_for(segment);
+    return 1;
+}
+/**********************************************************/
+//Memseg_mapped tells whether 'seg' names a mapped segment,
+//storing its length into 'length' if it does.
+extern int Memseg_mapped(T memSpace, uint32_t seg, uint32_t *length){
+    if (seg >= memSpace->count || memSpace->segments[seg] == 0){
+        return 0;
+    }
+    *length = segment_at(memSpace, seg)->length;
+    return 1;
+}
+/**********************************************************/
+//Memseg_decode builds the predecoded copy of segment 0
+extern int Memseg_decode(T memSpace){
+    Segment *segment = segment_at(memSpace, 0);
+    if (!decode(memSpace, segment)){
+        return 0;
+    }
+    memSpace->decoding = 1;
+    memSpace->segments[0] = entry_for(segment);
+    return 1;
+}
+/**********************************************************/
+//Memseg_decoded takes 'code' as the predecoded copy of
+//segment 0. It lies in the image, so release_segment never
+//gives it to free.
+extern void Memseg_decoded(T memSpace, Codeword *code){
+    Segment *segment = segment_at(memSpace, 0);
+    assert(in_image(memSpace, (Segment *)code));
+    memSpace->decoding = 1;
+    segment->u.code = code;
+    memSpace->segments[0] = entry_for(segment);
+}
+/**********************************************************/
+//Memseg_code returns the predecoded copy of segment 0 and
+//stores its length into 'length'.
+extern Codeword *Memseg_code(T memSpace, uint32_t *length){
+    Segment *segment = segment_at(memSpace, 0);
+    *length = segment->length;
+    return segment->u.code;
+}
+/**********************************************************/
+//Memseg_table returns the segment table of 'memSpace'
+extern uintptr_t *Memseg_table(T memSpace){
+    return memSpace->segments;
+}
+/**********************************************************/
+//Memseg_get_stats copies the counters of 'memSpace' into
+//'stats'.
+extern void Memseg_get_stats(T memSpace, Memseg_stats *stats){
+    *stats = memSpace->stats;
+    stats->bytesHeld += (size_t)(memSpace->limit - memSpace->bump);
+    stats->freeIds = memSpace->unmappedCount;
+    stats->segments = memSpace->count - memSpace->unmappedCount;
+    stats->maps = 0;
+    for (int k = 0; k < MEMSEG_BUCKETS; ++k){
+        stats->maps += stats->sizes[k];
+    }
+    stats->unmaps = stats->maps + stats->restored - stats->segments;
+}
+/**********************************************************/
+//Memseg_footprint takes the footprint sample that is due, if
+//any, where the memory space itself has not had the chance.
+extern void Memseg_footprint(T memSpace){
+    footprint(memSpace);
+}
+/**********************************************************/
+//Memseg_segment returns a pointer to the first word of segment
+//'seg' and stores its length in words into 'length'.
+extern uint32_t *Memseg_segment(T memSpace, uint32_t seg, uint32_t *length){
+    Segment *segment = segment_at(memSpace, seg);
+    *length = segment->length;
+    return segment->words;
+}
+/**********************************************************/
+//The memory section of a snapshot, as Memseg_save writes it,
+//starts with a Saved header giving the number of IDs and of
+//unmapped IDs. The unmapped IDs follow in the order of the
+//unmapped list, and then, from a multiple of 8, the offset of
+//each ID's segment from the start of the section, 0 for an
+//unmapped ID. The segments follow from a multiple of 16,
+//each laid out as a Segment with refs 1 and no code, and
+//padded to 16 bytes, so a restore can use them in place.
+//Every ID gets a segment of its own, even one it shares.
+typedef struct Saved {
+    uint32_t count, unmappedCount;
+} Saved;
+
+//Function align rounds 'offset' up to a multiple of 'to'
+static inline size_t align(size_t offset, size_t to){
+    return (offset + to - 1) & ~(to - 1);
+}
+/**********************************************************/
+//Function pad writes zeros to bring 'written' bytes up to
+//'to', returning 'to'
+static size_t pad(FILE *fp, size_t written, size_t to){
+    static const unsigned char zeros[ALIGNMENT];
+    assert(to - written <= ALIGNMENT);
+    fwrite(zeros, 1, to - written, fp);
+    return to;
+}
+/**********************************************************/
+//Memseg_save writes the memory section for 'memSpace' at
+//the current position of 'fp'. The offsets are worked out
+//in a first pass over the table, and the segments written in
+//a second.
+extern size_t Memseg_save(T memSpace, FILE *fp){
+    Saved saved = { memSpace->count, memSpace->unmappedCount };
+    size_t written = sizeof(saved);
+    fwrite(&saved, sizeof(saved), 1, fp);
+    fwrite(memSpace->unmapped, sizeof(uint32_t), saved.unmappedCount, fp);
+    written += saved.unmappedCount * sizeof(uint32_t);
+    written = pad(fp, written, align(written, sizeof(uint64_t)));
+
+    size_t offset = align(written + saved.count * sizeof(uint64_t), ALIGNMENT);
+    for (uint32_t i = 0; i < saved.count; ++i){
+        Segment *segment = segment_at(memSpace, i);
+        uint64_t at = 0;
+        if (segment != NULL){
+            at = offset;
+            offset += align(segment_bytes(segment->length), ALIGNMENT);
+        }
+        fwrite(&at, sizeof(at), 1, fp);
+    }
+    written += saved.count * sizeof(uint64_t);
+    written = pad(fp, written, align(written, ALIGNMENT));
+
+    for (uint32_t i = 0; i < saved.count; ++i){
+        Segment *segment = segment_at(memSpace, i);
+        if (segment == NULL){
+            continue;
+        }
+        Segment header = { segment->length, 1, { NULL } };
+        fwrite(&header, sizeof(header), 1, fp);
+        fwrite(segment->words, sizeof(uint32_t), segment->length, fp);
+        written += segment_bytes(segment->length);
+        written = pad(fp, written, align(written, ALIGNMENT));
+    }
+    assert(written == offset);
+    return written;
+}
+/**********************************************************/
+//Memseg_try_restore rebuilds the table and the unmapped list
+//from the memory section at 'offset' in 'image', checking
+//that every segment lies within the image. Only the table,
+//the unmapped list and the segment headers are read, so the
+//words stay on disk until the program touches them.
+extern T Memseg_try_restore(Memseg_alloc policy, void *image, size_t size,
+                            size_t offset){
+    T memSpace = Memseg_new(policy);
+    unsigned char *base = (unsigned char *)image + offset;
+    size_t room = size - offset;
+
+    Saved saved;
+    if (offset > size || room < sizeof(saved) || offset % ALIGNMENT != 0){
+        goto corrupt;
+    }
+    memcpy(&saved, base, sizeof(saved));
+    size_t offsets = align(sizeof(saved) + (size_t)saved.unmappedCount * sizeof(uint32_t),
+                           sizeof(uint64_t));
+    if (saved.unmappedCount > saved.count ||
+        offsets + (size_t)saved.count * sizeof(uint64_t) > room){
+        goto corrupt;
+    }
+    host_give(memSpace, malloc_bytes(memSpace->capacity * sizeof(uintptr_t)) +
+              malloc_bytes(memSpace->unmappedCapacity * sizeof(uint32_t)));
+    while (memSpace->capacity < saved.count){
+        memSpace->capacity *= 2;
+    }
+    while (memSpace->unmappedCapacity < saved.unmappedCount){
+        memSpace->unmappedCapacity *= 2;
+    }
+    memSpace->segments = realloc(memSpace->segments,
+                                 memSpace->capacity * sizeof(uintptr_t));
+    memSpace->unmapped = realloc(memSpace->unmapped,
+                                 memSpace->unmappedCapacity * sizeof(uint32_t));
+    assert(memSpace->segments);
+    assert(memSpace->unmapped);
+    host_take(memSpace, malloc_bytes(memSpace->capacity * sizeof(uintptr_t)) +
+              malloc_bytes(memSpace->unmappedCapacity * sizeof(uint32_t)));
+    memcpy(memSpace->unmapped, base + sizeof(saved),
+           saved.unmappedCount * sizeof(uint32_t));
+    memSpace->unmappedCount = saved.unmappedCount;
+    memSpace->stats.peakFreeIds = saved.unmappedCount;
+
+    for (uint32_t i = 0; i < saved.count; ++i){
+        uint64_t at;
+        memcpy(&at, base + offsets + i * sizeof(uint64_t), sizeof(at));
+        memSpace->segments[i] = 0;
+        if (at == 0){
+            continue;
+        }
+        Segment *segment = (Segment *)(base + at);
+        if (at % ALIGNMENT != 0 || room < sizeof(Segment) ||
+            at > room - sizeof(Segment) ||
+            segment_bytes(segment->length) > room - at ||
+            segment->refs != 1 || segment->u.code != NULL){
+            goto corrupt;
+        }
+        memSpace->segments[i] = (uintptr_t)segment;
+        memSpace->stats.words += segment->length;
+    }
+    memSpace->count = saved.count;
+    memSpace->stats.peakSegments = saved.count - saved.unmappedCount;
+    memSpace->stats.peakWords = memSpace->stats.words;
+    memSpace->stats.restored = memSpace->stats.peakSegments;
+    if (saved.count == 0 || memSpace->segments[0] == 0){
+        goto corrupt;
+    }
+
+    memSpace->image = image;
+    memSpace->imageSize = size;
+    host_take(memSpace, size);
+    return memSpace;
+
+corrupt:
+    //None of the segments is the memory space's to release
+    memSpace->count = 0;
+    Memseg_free(memSpace);
+    return NULL;
+}
+/**********************************************************/
+//Memseg_restore is Memseg_try_restore for a memory section
+//that has to be sound, exiting if it is not
+extern T Memseg_restore(Memseg_alloc policy, void *image, size_t size,
+                        size_t offset){
+    T memSpace = Memseg_try_restore(policy, image, size, offset);
+    if (memSpace == NULL){
+        fprintf(stderr, "Error, snapshot memory is corrupt.\n");
+        exit(1);
+    }
+    return memSpace;
 }
 /**********************************************************/
 //Memspace_free frees the memory space used up by the passed
-//in 'memSpace' struct.
+//in 'memSpace' struct. An arena is released chunk by chunk,
+//however many segments were carved out of it, and only its
+//large segments are unmapped one at a time.
 extern void Memseg_free(T memSpace){
 
-    int totalSpace = Seq_length(memSpace->segments);
-    Array_T segment;
+    if (memSpace->policy == MEMSEG_ARENA){
+        while (memSpace->chunks != NULL){
+            Chunk *chunk = memSpace->chunks;
+            memSpace->chunks = chunk->next;
+            free(chunk);
+        }
 
-    //Iterate through all of the segment in the memory space
-    //and free them.
-    for (int i = 0;i < totalSpace;++i){
-        segment = Seq_remhi(memSpace->segments);
-        if (segment != NULL){
-            Array_free(&segment);
+        //Large segments are the only ones outside the chunks
+        while (memSpace->mappings != NULL){
+            Mapping *mapping = memSpace->mappings;
+            memSpace->mappings = mapping->next;
+            munmap(mapping, map_bytes(((Segment *)(mapping + 1))->length));
+        }
+    }
+    else{
+
+        //Iterate through all of the segment in the memory space
+        //and free them. Unmapped IDs hold 0.
+        for (uint32_t i = 0; i < memSpace->count; ++i){
+            release_segment(memSpace, segment_at(memSpace, i));
+        }
+
+        //Then the segments waiting for reuse
+        for (uint32_t size = 0; size < CLASSES; ++size){
+            while (memSpace->freeLists[size] != NULL){
+                Segment *segment = memSpace->freeLists[size];
+                memSpace->freeLists[size] = segment->u.next;
+                if (!in_image(memSpace, segment)){
+                    free(segment);
+                }
+            }
         }
     }
+    for (unsigned i = 0; i < memSpace->spareCount; ++i){
+        munmap(memSpace->spares[i], memSpace->spareBytes[i]);
+    }
+    if (memSpace->image != NULL){
+        munmap(memSpace->image, memSpace->imageSize);
+    }
 
     //Free the actual memory space stucture
-    Seq_free(&(memSpace->segments));
-    Stack_free(&(memSpace->unmapped));
+    free(memSpace->segments);
+    free(memSpace->unmapped);
     free(memSpace);
 }
-/**********************************************************/
\ No newline at end of file
+/**********************************************************/
@@ -5,17 +5,70 @@
 #ifndef MEMSEG_INCLUDED
 #define MEMSEG_INCLUDED
 #include <inttypes.h>
+#include <stdio.h>
+#include "um_decode.h"
 #define T Memseg_T
 typedef struct T *T;
 /**********************************************************************/
+//A Memseg_alloc names how a memory space allocates its segments.
+//MEMSEG_MALLOC calls malloc and free for every segment. MEMSEG_SLAB
+//keeps freed short segments on a free list per length and reuses
+//them for the next segment of that length. MEMSEG_ARENA does the
+//same, but carves all segments out of large chunks and releases
+//the chunks at once when the memory space is freed. Under every
+//policy a segment of 64K words or more gets an anonymous mapping of
+//its own instead, which the kernel zeroes page by page as it is
+//touched, hinted for transparent huge pages once it is 2 MB, and
+//whose pages go back to the kernel when it is unmapped.
+typedef enum Memseg_alloc {
+    MEMSEG_MALLOC, MEMSEG_SLAB, MEMSEG_ARENA
+} Memseg_alloc;
+//A Memseg_stats holds the counters of a memory space.
+//copiesAvoided and copiesMade count Memseg_load_prog calls that
+//shared a segment instead of copying it, and the copies a later
+//store into a sharing segment forced after all, and bytesCopied
+//the words those copies took, in bytes. allocHits and
+//allocMisses count segment allocations served from a free list and
+//those that were not. bytesHeld counts bytes the allocator holds
+//that no segment is using.
+//The footprint counters follow. segments counts the mapped IDs,
+//segment 0 among them, and words their words, as the program sees
+//them, however many share a segment; peakSegments and peakWords
+//are their high water marks. maps and unmaps count the calls to
+//Memseg_map and Memseg_unmap, and restored the IDs a restored
+//memory space started with. freeIds is the depth of the list of
+//unmapped IDs waiting for reuse, and peakFreeIds its high water
+//mark. hostBytes counts the bytes the memory space has taken from
+//the host for itself, its table and lists, segments, predecoded
+//code, arena chunks and restored image, with malloc's own header
+//and rounding estimated as glibc's; peakHostBytes is its high
+//water mark. sizes[0] counts the maps of no words, and sizes[k]
+//those of 2^(k-1) to 2^k - 1 words.
+#define MEMSEG_BUCKETS 33
+typedef struct Memseg_stats {
+    uint64_t copiesAvoided, copiesMade, bytesCopied;
+    uint64_t allocHits, allocMisses;
+    uint64_t bytesHeld;
+    uint64_t segments, words, peakSegments, peakWords;
+    uint64_t maps, unmaps, restored;
+    uint64_t freeIds, peakFreeIds;
+    uint64_t hostBytes, peakHostBytes;
+    uint64_t sizes[MEMSEG_BUCKETS];
+} Memseg_stats;
+/**********************************************************************/
 extern T Memseg_init();
 //Memseg_init creates a new Memseg_T memory segment,
 //initializes all of its values to empty, and returns the
-//new memory segment.
-extern void Memseg_store(T memSpace,uint32_t elem,int seg, int offset);
+//new memory segment. It allocates under MEMSEG_SLAB.
+extern T Memseg_new(Memseg_alloc policy);
+//Memseg_new creates an empty Memseg_T memory segment that
+//allocates its segments under 'policy'.
+extern int Memseg_store(T memSpace,uint32_t elem,int seg, int offset);
 //Memseg_store stores a new value 'elem' into the memory segment
 //located at 'seg'. It is placed into this word(memory segment)
-// at offset 'offset' 
+// at offset 'offset'. It returns 1, or 0 with nothing stored if
+//'seg' shares its words and the host has no memory for its own
+//copy of them.
 extern uint32_t Memseg_load(T memSpace,int seg,int offset);
 //Memseg_load loads a value from the memory space 'memSpace'
 //found in the segment 'seg' at offset 'offset'. This 
@@ -23,15 +76,81 @@ extern uint32_t Memseg_load(T memSpace,int seg,int offset);
 extern uint32_t Memseg_map(T memSpace, int size);
 //Memseg_map creates a new segment with a number of words
 //equal to 'size'. A pointer to this new segment is then
-//returned from the function
-extern void Memseg_unmap(T memSpace, uint32_t seg);
+//returned from the function. If the host has no memory for
+//the segment, or for the table to grow, nothing is mapped and
+//MEMSEG_NONE is returned instead.
+#define MEMSEG_NONE UINT32_MAX  //the ID Memseg_map never hands out
+extern int Memseg_unmap(T memSpace, uint32_t seg);
 //Memseg_unmap unmaps the memery segment 'seg' found in the
-//memory space memSpace.
-extern void Memseg_load_prog(T memSpace,int seg);
+//memory space memSpace. It returns 1, or 0 with nothing done
+//if 'seg' is 0 or not mapped.
+extern int Memseg_load_prog(T memSpace,int seg);
 //Memseg_load_prog duplicates the memory segment found in
 //'memSpace' at 'seg'. This segment is then loaded into 
 //'memSpace' at postion 0, and the former code at postion 0
-//is abandoned.
+//is abandoned. The words are copied lazily, on the first
+//store into either segment. It returns 1, or 0 with segment 0
+//as it was if the host has no memory to predecode the segment.
+extern uint32_t *Memseg_segment(T memSpace, uint32_t seg, uint32_t *length);
+//Memseg_segment returns a pointer to the first word of segment
+//'seg' and stores its length in words into 'length'. The pointer
+//is only good for reading, since the words may be shared with
+//other segments. For segment 0 it stays valid until the next
+//Memseg_load_prog, for any other segment until it is written or
+//unmapped.
+extern int Memseg_mapped(T memSpace, uint32_t seg, uint32_t *length);
+//Memseg_mapped returns 1 and stores the length of segment 'seg'
+//into 'length' if 'seg' is mapped, and returns 0 otherwise. It is
+//for engines that check each access before making it.
+extern int Memseg_decode(T memSpace);
+//Memseg_decode builds the predecoded copy of segment 0, with its
+//superinstructions fused by Decode_fuse. From then on stores into
+//segment 0 mark the word they overwrite, and a superinstruction
+//covering it, as DECODE_STALE and Memseg_load_prog rebuilds the
+//copy for the new segment 0. It returns 0 if the host has no
+//memory for the copy, and 1 otherwise.
+extern void Memseg_decoded(T memSpace, Codeword *code);
+//Memseg_decoded does what Memseg_decode does, but takes 'code', a
+//predecoded and fused copy of segment 0 that was built earlier and
+//lies in the image of a memory space restored by Memseg_restore,
+//where it is, instead of building one. The image must be writable.
+extern Codeword *Memseg_code(T memSpace, uint32_t *length);
+//Memseg_code returns the predecoded copy of segment 0, or NULL if
+//Memseg_decode was never called, and stores its length into
+//'length'. The pointer stays valid until the next Memseg_load_prog.
+extern uintptr_t *Memseg_table(T memSpace);
+//Memseg_table returns the segment table, for engines that generate
+//code which indexes it directly. Entry 'seg' with its MEMSEG_FLAGS
+//bits cleared points to the segment, whose words start MEMSEG_WORDS
+//bytes in. A store through an entry with any flag set has to go
+//through Memseg_store. The table moves when Memseg_map grows it.
+#define MEMSEG_FLAGS 3
+#define MEMSEG_WORDS 16
+extern void Memseg_get_stats(T memSpace, Memseg_stats *stats);
+//Memseg_get_stats copies the counters of 'memSpace' into 'stats'
+extern void Memseg_footprint(T memSpace);
+//Memseg_footprint takes a footprint sample of 'memSpace' if one is
+//due, for engines that look for one between maps
+extern size_t Memseg_save(T memSpace, FILE *fp);
+//Memseg_save writes every segment of 'memSpace' and its list
+//of unmapped IDs to 'fp', laid out so that Memseg_restore can
+//use the segments where they lie, and returns the bytes
+//written. 'fp' must be at a multiple of 16 bytes into a file.
+extern T Memseg_restore(Memseg_alloc policy, void *image, size_t size,
+                        size_t offset);
+//Memseg_restore returns a memory space holding what was saved
+//by Memseg_save at 'offset' bytes into 'image', a private,
+//writable mapping of 'size' bytes that it takes over and
+//unmaps when the memory space is freed. The segments stay in
+//the image and are written there in place; only new ones are
+//allocated under 'policy'. Call Memseg_decode or Memseg_decoded
+//before running it. A memory section that does not hold together
+//is a fatal error.
+extern T Memseg_try_restore(Memseg_alloc policy, void *image, size_t size,
+                            size_t offset);
+//Memseg_try_restore is Memseg_restore, but returns NULL for a
+//memory section that does not hold together, leaving 'image' to
+//the caller.
 extern void Memseg_free(T memSpace);
 //Memspace_free frees the memory space used up by the passed
 //in 'memSpace' struct.
@@ -0,0 +1,70 @@
+//Timothy Colaneri
+//Universal Machine opcode table
+
+/**********************************************************************/
+#ifndef OPS_INCLUDED
+#define OPS_INCLUDED
+/**********************************************************************/
+//UM_OPCODES lists every opcode as OP(number, name, check). 'name' is
+//its mnemonic, and 'check' names the validation the checked engine
+//does before running it:
+//  NONE     nothing can go wrong
+//  READ     segment r[b] is mapped and offset r[c] lies within it
+//  WRITE    segment r[a] is mapped and offset r[b] lies within it
+//  DIVIDE   r[c] is not zero
+//  UNMAP    segment r[c] is mapped and is not segment 0
+//  OUTPUT   r[c] is no more than 255
+//  PROGRAM  segment r[b] is mapped
+//  OPCODE   never passes, as the opcode is undefined
+//An engine generates its dispatch from the table and runs each opcode
+//through UM_OP_<number>, so the semantics live here once and every
+//engine, checked or not, counting or not, is built from them. Checks
+//cost nothing in an engine that does not expand them.
+#define UM_OPCODES(OP)                                                 \
+    OP(0,  cmov,     NONE)                                             \
+    OP(1,  load,     READ)                                             \
+    OP(2,  store,    WRITE)                                            \
+    OP(3,  add,      NONE)                                             \
+    OP(4,  mul,      NONE)                                             \
+    OP(5,  div,      DIVIDE)                                           \
+    OP(6,  nand,     NONE)                                             \
+    OP(7,  halt,     NONE)                                             \
+    OP(8,  map,      NONE)                                             \
+    OP(9,  unmap,    UNMAP)                                            \
+    OP(10, out,      OUTPUT)                                           \
+    OP(11, in,       NONE)                                             \
+    OP(12, loadprog, PROGRAM)                                          \
+    OP(13, loadval,  NONE)                                             \
+    OP(14, op14,     OPCODE)                                           \
+    OP(15, op15,     OPCODE)
+
+//UM_OP_<number>(r, w) runs the Codeword 'w' on the registers 'r'. It
+//expects 'program' and 'io' in scope, and the engine to define
+//UM_HALT() and UM_LOAD_PROGRAM(segment, counter), which are the only
+//instructions that change the flow of control, and UM_FAULT(status),
+//which stops the machine with 'status' at the instruction: a map, a
+//store into a shared segment or a load program the host has no
+//memory for, or an unmap of segment 0 or of one that is not mapped.
+//The undefined opcodes do nothing.
+#define UM_OP_0(r, w)  do { if (r[w.c] != 0) r[w.a] = r[w.b]; } while (0)
+#define UM_OP_1(r, w)  (r[w.a] = Memseg_load(program, r[w.b], r[w.c]))
+#define UM_OP_2(r, w)  do { if (!Memseg_store(program, r[w.c], r[w.a], r[w.b]))   \
+                                UM_FAULT(INTERP_MEMORY); } while (0)
+#define UM_OP_3(r, w)  (r[w.a] = r[w.b] + r[w.c])
+#define UM_OP_4(r, w)  (r[w.a] = r[w.b] * r[w.c])
+#define UM_OP_5(r, w)  (r[w.a] = r[w.b] / r[w.c])
+#define UM_OP_6(r, w)  (r[w.a] = ~(r[w.b] & r[w.c]))
+#define UM_OP_7(r, w)  UM_HALT()
+#define UM_OP_8(r, w)  do { uint32_t id_ = Memseg_map(program, r[w.c]);  \
+                            if (id_ == MEMSEG_NONE) UM_FAULT(INTERP_MEMORY); \
+                            r[w.b] = id_; } while (0)
+#define UM_OP_9(r, w)  do { if (!Memseg_unmap(program, r[w.c]))                 \
+                                UM_FAULT(INTERP_UNMAPPED); } while (0)
+#define UM_OP_10(r, w) Umio_put(io, r[w.c])
+#define UM_OP_11(r, w) (r[w.c] = Umio_get(io))
+#define UM_OP_12(r, w) UM_LOAD_PROGRAM(r[w.b], r[w.c])
+#define UM_OP_13(r, w) (r[w.a] = w.value)
+#define UM_OP_14(r, w) ((void)0)
+#define UM_OP_15(r, w) ((void)0)
+/**********************************************************************/
+#endif
@@ -0,0 +1,165 @@
+//Timothy Colaneri
+//Universal Machine execution profile implementation
+
+/**********************************************************************/
+#include<stdlib.h>
+#include<string.h>
+#include<assert.h>
+#include"um_profile.h" //Own header
+#include"um_ops.h"     //Opcode names
+/**********************************************************************/
+#define HOT     20  //PCs listed in the report
+#define REGIONS 5   //regions of disassembly around hot PCs
+#define BEFORE  4   //words shown ahead of a hot PC
+#define AFTER   12  //words shown after a hot PC
+
+//A Hot is one PC of the hot list
+typedef struct Hot {
+    uint64_t count;
+    uint32_t pc;
+} Hot;
+/**********************************************************************/
+//Function Profile_init starts a profile with every count at zero
+extern void Profile_init(Profile *profile, uint32_t length){
+    memset(profile, 0, sizeof(*profile));
+    Profile_grow(profile, length);
+}
+/**********************************************************************/
+//Function Profile_grow extends the per PC counts with zeros
+extern void Profile_grow(Profile *profile, uint32_t length){
+    if (length <= profile->length && profile->pcs != NULL){
+        return;
+    }
+    //One spare count keeps an empty segment 0 from asking for 0 bytes
+    profile->pcs = realloc(profile->pcs, ((size_t)length + 1) * sizeof(uint64_t));
+    assert(profile->pcs);
+    memset(profile->pcs + profile->length, 0,
+           ((size_t)length + 1 - profile->length) * sizeof(uint64_t));
+    profile->length = length;
+}
+/**********************************************************************/
+//Function by_count orders Hots from most to least executed
+static int by_count(const void *x, const void *y){
+    const Hot *a = x, *b = y;
+    return (a->count < b->count) - (a->count > b->count);
+}
+/**********************************************************************/
+//Function Profile_total adds up the executions of every opcode
+extern uint64_t Profile_total(Profile *profile){
+    uint64_t total = 0;
+    for (int op = 0; op < 16; ++op){
+        total += profile->opcodes[op];
+    }
+    return total;
+}
+/**********************************************************************/
+//Function percent returns 'part' as a percentage of 'whole'
+static double percent(uint64_t part, uint64_t whole){
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
+/**********************************************************************/
+//Function disassemble writes the word at 'pc' of segment 0, which is
+//blank past its end
+static void disassemble(const uint32_t *words, uint32_t length, uint32_t pc,
+                        char *text, size_t size){
+    text[0] = '\0';
+    if (pc < length){
+        Decode_format(Decode_word(words[pc]), text, size);
+    }
+}
+/**********************************************************************/
+//Function Profile_report ranks the PCs by their counts and prints the
+//report. The disassembly shows segment 0 as it is at the time of the
+//report.
+extern void Profile_report(Profile *profile, Memseg_T program, FILE *out){
+#define NAME(n, name, check) #name,
+    static const char *const names[16] = { UM_OPCODES(NAME) };
+#undef NAME
+    char text[64];
+
+    uint64_t total = Profile_total(profile);
+    fprintf(out, "profile: %" PRIu64 " instructions\n", total);
+
+    //Opcodes
+    fprintf(out, "\nopcode           count   share\n");
+    for (int op = 0; op < 16; ++op){
+        if (profile->opcodes[op] != 0){
+            fprintf(out, "%-8s %14" PRIu64 " %6.2f%%\n", names[op],
+                    profile->opcodes[op], percent(profile->opcodes[op], total));
+        }
+    }
+
+    //Load programs and what they cost the memory space
+    Memseg_stats stats;
+    Memseg_get_stats(program, &stats);
+    fprintf(out, "\nload programs:            %" PRIu64 "\n", profile->loads);
+    fprintf(out, "  from another segment:   %" PRIu64 "\n", profile->farLoads);
+    fprintf(out, "  bytes loaded:           %" PRIu64 "\n",
+            profile->wordsLoaded * sizeof(uint32_t));
+    fprintf(out, "  copies made on write:   %" PRIu64 "\n", stats.copiesMade);
+    fprintf(out, "  bytes copied:           %" PRIu64 "\n", stats.bytesCopied);
+
+    //Hot PCs
+    Hot *hot = malloc(((size_t)profile->length + 1) * sizeof(Hot));
+    assert(hot);
+    uint32_t found = 0;
+    for (uint32_t pc = 0; pc < profile->length; ++pc){
+        if (profile->pcs[pc] != 0){
+            hot[found].count = profile->pcs[pc];
+            hot[found].pc = pc;
+            ++found;
+        }
+    }
+    qsort(hot, found, sizeof(Hot), by_count);
+
+    uint32_t length;
+    const uint32_t *words = Memseg_segment(program, 0, &length);
+    fprintf(out, "\nhot PCs       pc          count   share  instruction\n");
+    for (uint32_t i = 0; i < found && i < HOT; ++i){
+        disassemble(words, length, hot[i].pc, text, sizeof(text));
+        fprintf(out, "%7" PRIu32 " %8" PRIu32 " %14" PRIu64 " %6.2f%%  %s\n",
+                i + 1, hot[i].pc, hot[i].count, percent(hot[i].count, total), text);
+    }
+
+    //The code around the hottest PCs, marking each hot PC. A region
+    //already shown around a hotter PC is not shown again.
+    uint32_t shownFirst[REGIONS], shownLast[REGIONS];
+    uint32_t regions = 0;
+    for (uint32_t i = 0; i < found && regions < REGIONS; ++i){
+        uint32_t pc = hot[i].pc;
+        int shown = 0;
+        for (uint32_t r = 0; r < regions; ++r){
+            shown |= shownFirst[r] <= pc && pc <= shownLast[r];
+        }
+        if (shown){
+            continue;
+        }
+        uint32_t first = pc < BEFORE ? 0 : pc - BEFORE;
+        uint32_t last = pc + AFTER < profile->length ? pc + AFTER : profile->length - 1;
+        shownFirst[regions] = first;
+        shownLast[regions] = last;
+        ++regions;
+
+        fprintf(out, "\nregion around pc %" PRIu32 ":\n", pc);
+        for (uint32_t at = first; at <= last; ++at){
+            int rank = 0;
+            for (uint32_t h = 0; h < found && h < HOT; ++h){
+                if (hot[h].pc == at){
+                    rank = h + 1;
+                }
+            }
+            disassemble(words, length, at, text, sizeof(text));
+            fprintf(out, "%c %8" PRIu32 " %14" PRIu64 "  %s\n", rank ? '>' : ' ',
+                    at, profile->pcs[at], text);
+        }
+    }
+    free(hot);
+}
+/**********************************************************************/
+//Function Profile_free releases the per PC counts
+extern void Profile_free(Profile *profile){
+    free(profile->pcs);
+    profile->pcs = NULL;
+    profile->length = 0;
+}
+/**********************************************************************/
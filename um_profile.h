@@ -0,0 +1,42 @@
+//Timothy Colaneri
+//Universal Machine execution profile interface
+
+/**********************************************************************/
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+#include <stdio.h>
+#include <inttypes.h>
+#include "um_mem.h"
+/**********************************************************************/
+//A Profile holds the counts Interp_prog_profile keeps as it runs.
+//opcodes[op] counts the executions of each opcode and pcs[pc] those
+//of each word of segment 0, for 'length' words. A load program from
+//another segment leaves the counts in place, so a PC counts the
+//executions of every program that was segment 0 at the time. loads
+//counts load programs, farLoads those from another segment, and
+//wordsLoaded the words those brought into segment 0.
+typedef struct Profile {
+    uint64_t opcodes[16];
+    uint64_t *pcs;
+    uint32_t length;
+    uint64_t loads, farLoads, wordsLoaded;
+} Profile;
+/**********************************************************************/
+extern void Profile_init(Profile *profile, uint32_t length);
+//Profile_init clears 'profile' and makes room to count 'length'
+//words of segment 0
+extern void Profile_grow(Profile *profile, uint32_t length);
+//Profile_grow makes room to count 'length' words of segment 0,
+//keeping the counts so far
+extern uint64_t Profile_total(Profile *profile);
+//Profile_total returns the number of instructions counted in
+//'profile'
+extern void Profile_report(Profile *profile, Memseg_T program, FILE *out);
+//Profile_report writes the report for 'profile' to 'out': the
+//executions of each opcode, the load program counts with the bytes
+//the memory space copied for them, the hottest PCs, and an annotated
+//disassembly of segment 0 around the hottest of those
+extern void Profile_free(Profile *profile);
+//Profile_free frees the counts held by 'profile'
+/**********************************************************************/
+#endif
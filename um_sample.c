@@ -0,0 +1,168 @@
+//Timothy Colaneri
+//Universal Machine sampling profiler implementation
+
+/* The profiling timer (ITIMER_PROF) only sets Sample_due; the
+threaded engine notices it at its next load program and calls
+Sample_take, which does the real work outside the signal handler.
+A sample is the PC of that load program below the targets of the
+ones before it, which are the closest thing a UM program has to a
+call stack; the last of them starts the code the PC ends. Identical stacks are counted together in a hash table. */
+
+/**********************************************************************/
+#define _XOPEN_SOURCE 700   //sigaction, setitimer
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<assert.h>
+#include<sys/time.h>
+#include"um_sample.h" //Own header
+/**********************************************************************/
+volatile sig_atomic_t Sample_due = 0;
+
+//A Stack is one distinct sampled stack: 'depth' frames, oldest first,
+//the last of which is the sampled PC
+typedef struct Stack {
+    uint64_t count;
+    uint32_t depth;
+    uint32_t frames[SAMPLE_DEPTH + 1];
+} Stack;
+
+//The samples taken so far, in an open addressing table of 'capacity'
+//Stacks, 'count' of which are in use
+static Stack *stacks;
+static size_t count, capacity;
+static const char *outPath;
+/**********************************************************************/
+//Function on_timer asks the interpreter for a sample
+static void on_timer(int sig){
+    (void)sig;
+    Sample_due = 1;
+}
+/**********************************************************************/
+//Function Sample_start installs the handler and arms the timer
+extern void Sample_start(const char *path, unsigned hz){
+    outPath = path;
+    capacity = 1024;
+    count = 0;
+    stacks = calloc(capacity, sizeof(Stack));
+    assert(stacks);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_timer;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(SIGPROF, &action, NULL) != 0){
+        fprintf(stderr, "Error, cannot install the sampling handler.\n");
+        exit(1);
+    }
+
+    struct itimerval timer;
+    if (hz == 0 || hz > 1000000){
+        hz = SAMPLE_HZ;
+    }
+    timer.it_interval.tv_sec = 1 / hz;
+    timer.it_interval.tv_usec = (1000000 / hz) % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0){
+        fprintf(stderr, "Error, cannot start the sampling timer.\n");
+        exit(1);
+    }
+}
+/**********************************************************************/
+//Function hash_stack hashes the frames of a stack with FNV-1a
+static size_t hash_stack(const uint32_t *frames, uint32_t depth){
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint32_t i = 0; i < depth; ++i){
+        hash = (hash ^ frames[i]) * 1099511628211ULL;
+    }
+    return (size_t)(hash ^ (hash >> 32));
+}
+//Function find_stack returns the slot of the stack 'frames' in the
+//table, which is either that stack or an empty slot for it
+static Stack *find_stack(Stack *table, size_t size, const uint32_t *frames,
+                         uint32_t depth){
+    size_t slot = hash_stack(frames, depth) & (size - 1);
+    while (table[slot].count != 0 &&
+           (table[slot].depth != depth ||
+            memcmp(table[slot].frames, frames, depth * sizeof(uint32_t)) != 0)){
+        slot = (slot + 1) & (size - 1);
+    }
+    return &table[slot];
+}
+//Function grow doubles the table, keeping it at most half full
+static void grow(void){
+    size_t size = 2 * capacity;
+    Stack *table = calloc(size, sizeof(Stack));
+    assert(table);
+    for (size_t i = 0; i < capacity; ++i){
+        if (stacks[i].count != 0){
+            *find_stack(table, size, stacks[i].frames, stacks[i].depth) = stacks[i];
+        }
+    }
+    free(stacks);
+    stacks = table;
+    capacity = size;
+}
+/**********************************************************************/
+//Function Sample_take unrolls the ring of load program targets into
+//frames, oldest first, and counts the stack
+extern void Sample_take(uint32_t pc, const uint32_t *history, uint64_t loads){
+    Sample_due = 0;
+    if (stacks == NULL){
+        return;
+    }
+
+    uint32_t frames[SAMPLE_DEPTH + 1];
+    uint32_t depth = 0;
+    uint64_t kept = loads < SAMPLE_DEPTH ? loads : SAMPLE_DEPTH;
+    for (uint64_t i = loads - kept; i < loads; ++i){
+        frames[depth++] = history[i % SAMPLE_DEPTH];
+    }
+    frames[depth++] = pc;
+
+    if (2 * (count + 1) > capacity){
+        grow();
+    }
+    Stack *stack = find_stack(stacks, capacity, frames, depth);
+    if (stack->count == 0){
+        stack->depth = depth;
+        memcpy(stack->frames, frames, depth * sizeof(uint32_t));
+        ++count;
+    }
+    ++stack->count;
+}
+/**********************************************************************/
+//Function Sample_stop disarms the timer and writes one line per stack.
+//Load program targets are named jmp_PC and the sampled PC pc_PC.
+extern void Sample_stop(void){
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    if (stacks == NULL){
+        return;
+    }
+
+    FILE *out = fopen(outPath, "w");
+    if (out == NULL){
+        fprintf(stderr, "Error, cannot open sample file %s.\n", outPath);
+        exit(1);
+    }
+    for (size_t i = 0; i < capacity; ++i){
+        Stack *stack = &stacks[i];
+        if (stack->count == 0){
+            continue;
+        }
+        for (uint32_t f = 0; f + 1 < stack->depth; ++f){
+            fprintf(out, "jmp_%" PRIu32 ";", stack->frames[f]);
+        }
+        fprintf(out, "pc_%" PRIu32 " %" PRIu64 "\n",
+                stack->frames[stack->depth - 1], stack->count);
+    }
+    fclose(out);
+
+    free(stacks);
+    stacks = NULL;
+    count = capacity = 0;
+}
+/**********************************************************************/
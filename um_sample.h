@@ -0,0 +1,32 @@
+//Timothy Colaneri
+//Universal Machine sampling profiler interface
+
+/**********************************************************************/
+#ifndef SAMPLE_INCLUDED
+#define SAMPLE_INCLUDED
+#include <signal.h>
+#include <inttypes.h>
+/**********************************************************************/
+//Sample_due is set by the profiling timer and cleared by Sample_take.
+//Interp_prog_watched checks it after each load program, so a sample
+//is always taken at an instruction boundary with the PC in hand.
+extern volatile sig_atomic_t Sample_due;
+//SAMPLE_DEPTH is the number of recent load program targets kept as
+//the stand-in for a call stack
+#define SAMPLE_DEPTH 8
+#define SAMPLE_HZ 1000
+/**********************************************************************/
+extern void Sample_start(const char *path, unsigned hz);
+//Sample_start starts a timer that asks for a sample 'hz' times per
+//second of CPU time. The samples go to the file 'path' when
+//Sample_stop is called.
+extern void Sample_take(uint32_t pc, const uint32_t *history, uint64_t loads);
+//Sample_take records one sample at segment 0 PC 'pc'. 'history' is
+//a ring of SAMPLE_DEPTH load program targets, the last of which was
+//written by load program number 'loads', counting from 1.
+extern void Sample_stop(void);
+//Sample_stop stops the timer and writes the samples as collapsed
+//stacks, one line per distinct stack with its count, oldest frame
+//first, in the form flame graph tools read
+/**********************************************************************/
+#endif
@@ -0,0 +1,128 @@
+//Timothy Colaneri
+//Universal Machine snapshot implementation
+
+/* A snapshot file is a Header followed by the memory section
+Memseg_save writes. The file is in the byte order of the machine
+that wrote it, which the Header records so another machine refuses
+it instead of running garbage. The Header is padded to 64 bytes so
+that the memory section, and with it every segment, lands on the
+16 byte boundary the segment table needs when the file is mapped. */
+
+/**********************************************************************/
+#define _XOPEN_SOURCE 700   //sigaction, mmap
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<assert.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include"um_snapshot.h" //Own header
+/**********************************************************************/
+#define MAGIC   "UMSNAP1"    //first 8 bytes of a snapshot, with the NUL
+#define ORDER   0x01020304u  //reads back differently in another byte order
+#define HEADER  64           //bytes before the memory section
+
+//A Header opens every snapshot
+typedef struct Header {
+    char magic[8];
+    uint32_t order;
+    uint32_t pc;
+    uint32_t registers[8];
+    unsigned char unused[HEADER - 48];
+} Header;
+typedef char check_header[sizeof(Header) == HEADER ? 1 : -1];
+
+volatile sig_atomic_t Snapshot_requested = 0;
+/**********************************************************************/
+//Function Snapshot_write writes the Header and then the memory section,
+//through a file that is renamed into place once it is complete, so a
+//snapshot taken over an older one never leaves half of each
+extern void Snapshot_write(const char *path, Memseg_T program,
+                           const uint32_t *registers, uint32_t pc){
+    size_t length = strlen(path);
+    char *partial = malloc(length + 6);
+    assert(partial);
+    memcpy(partial, path, length);
+    memcpy(partial + length, ".part", 6);
+
+    FILE *fp = fopen(partial, "wb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening snapshot %s.\n", partial);
+        exit(1);
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.order = ORDER;
+    header.pc = pc;
+    memcpy(header.registers, registers, sizeof(header.registers));
+    fwrite(&header, sizeof(header), 1, fp);
+    Memseg_save(program, fp);
+
+    if (ferror(fp) || fclose(fp) != 0 || rename(partial, path) != 0){
+        fprintf(stderr, "Error writing snapshot %s.\n", path);
+        exit(1);
+    }
+    free(partial);
+}
+/**********************************************************************/
+//Function Snapshot_read maps the file privately, so the machine writes
+//its own copy of each page it stores into and the file is left as it
+//was
+extern Memseg_T Snapshot_read(const char *path, Memseg_alloc policy,
+                              uint32_t *registers, uint32_t *pc){
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0){
+        fprintf(stderr, "Error opening snapshot %s.\n", path);
+        exit(1);
+    }
+    size_t size = (size_t)info.st_size;
+    if (size < sizeof(Header)){
+        fprintf(stderr, "Error, %s is not a snapshot.\n", path);
+        exit(1);
+    }
+    void *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED){
+        fprintf(stderr, "Error mapping snapshot %s.\n", path);
+        exit(1);
+    }
+
+    Header header;
+    memcpy(&header, image, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 ||
+        header.order != ORDER){
+        fprintf(stderr, "Error, %s is not a snapshot of this machine.\n", path);
+        exit(1);
+    }
+    memcpy(registers, header.registers, sizeof(header.registers));
+    *pc = header.pc;
+
+    Memseg_T program = Memseg_restore(policy, image, size, HEADER);
+    if (!Memseg_decode(program)){
+        fprintf(stderr, "Error, out of memory restoring %s.\n", path);
+        exit(1);
+    }
+    return program;
+}
+/**********************************************************************/
+//Function request is the handler for SNAPSHOT_SIGNAL
+static void request(int signal){
+    (void)signal;
+    Snapshot_requested = 1;
+}
+/**********************************************************************/
+//Function Snapshot_watch installs the handler, restarting the reads
+//and writes of the program's input and output it interrupts
+extern void Snapshot_watch(void){
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SNAPSHOT_SIGNAL, &action, NULL);
+}
+/**********************************************************************/
@@ -0,0 +1,34 @@
+//Timothy Colaneri
+//Universal Machine snapshot interface
+
+/**********************************************************************/
+#ifndef SNAPSHOT_INCLUDED
+#define SNAPSHOT_INCLUDED
+#include <signal.h>
+#include <inttypes.h>
+#include "um_mem.h"
+/**********************************************************************/
+//Snapshot_requested is set when the snapshot signal arrives, once
+//Snapshot_watch has been called. Interp_prog_until and
+//Interp_prog_watched stop on it.
+extern volatile sig_atomic_t Snapshot_requested;
+//SNAPSHOT_SIGNAL asks a running machine for a snapshot
+#define SNAPSHOT_SIGNAL SIGUSR2
+/**********************************************************************/
+extern void Snapshot_write(const char *path, Memseg_T program,
+                           const uint32_t *registers, uint32_t pc);
+//Snapshot_write writes the whole machine to the file 'path': the
+//eight registers, 'pc', the PC of the next instruction, and every
+//segment of 'program' with its unmapped IDs
+extern Memseg_T Snapshot_read(const char *path, Memseg_alloc policy,
+                              uint32_t *registers, uint32_t *pc);
+//Snapshot_read maps the snapshot 'path' into memory and returns
+//its memory space, predecoded and allocating new segments under
+//'policy', along with its registers and PC. The segments are used
+//where they lie in the mapping, so the restore reads only the
+//segment table before the machine runs again.
+extern void Snapshot_watch(void);
+//Snapshot_watch sets Snapshot_requested whenever SNAPSHOT_SIGNAL
+//arrives
+/**********************************************************************/
+#endif
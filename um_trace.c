@@ -0,0 +1,112 @@
+//Timothy Colaneri
+//Universal Machine instruction trace implementation
+
+/**********************************************************************/
+#define _XOPEN_SOURCE 700   //sigaction
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<assert.h>
+#include"um_trace.h" //Own header
+/**********************************************************************/
+volatile sig_atomic_t Trace_requested = 0;
+/**********************************************************************/
+//Function start opens block number 'trace->started' of the ring with
+//its key record
+static void start(Trace *trace){
+    unsigned char *block = trace->ring + (trace->started % trace->blocks) * TRACE_BLOCK;
+    trace->cur = block;
+    trace->limit = block + TRACE_BLOCK - TRACE_RECORD;
+    *trace->cur++ = TRACE_KEY;
+    Trace_varint(trace, trace->expect);
+    Trace_varint(trace, trace->count);
+}
+/**********************************************************************/
+extern void Trace_init(Trace *trace, const char *path, size_t bytes){
+    trace->blocks = bytes / TRACE_BLOCK > 1 ? bytes / TRACE_BLOCK : 2;
+    trace->ring = malloc((size_t)trace->blocks * TRACE_BLOCK);
+    trace->fill = calloc(trace->blocks, sizeof(uint32_t));
+    if (trace->ring == NULL || trace->fill == NULL){
+        fprintf(stderr, "Error, out of memory for the trace.\n");
+        exit(1);
+    }
+    trace->started = 0;
+    trace->expect = 0;
+    trace->count = 0;
+    trace->path = path;
+    start(trace);
+}
+/**********************************************************************/
+//Function Trace_block notes how full the block it leaves is
+extern void Trace_block(Trace *trace){
+    uint32_t slot = trace->started % trace->blocks;
+    trace->fill[slot] = trace->cur - (trace->ring + (size_t)slot * TRACE_BLOCK);
+    ++trace->started;
+    start(trace);
+}
+/**********************************************************************/
+//Function Trace_write writes through a file that is renamed into
+//place once it is complete, as Snapshot_write does
+extern void Trace_write(Trace *trace, int status, uint32_t pc){
+    size_t length = strlen(trace->path);
+    char *partial = malloc(length + 6);
+    assert(partial);
+    memcpy(partial, trace->path, length);
+    memcpy(partial + length, ".part", 6);
+
+    FILE *fp = fopen(partial, "wb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening trace %s.\n", partial);
+        exit(1);
+    }
+
+    //The current block is block number 'started', and still filling
+    uint64_t newest = trace->started;
+    uint64_t kept = newest + 1 < trace->blocks ? newest + 1 : trace->blocks;
+    Trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.order = TRACE_ORDER;
+    header.blockSize = TRACE_BLOCK;
+    header.blocks = kept;
+    header.status = status;
+    header.pc = pc;
+    header.count = trace->count;
+    header.dropped = newest + 1 - kept;
+    fwrite(&header, sizeof(header), 1, fp);
+
+    for (uint64_t b = newest + 1 - kept; b <= newest; ++b){
+        uint32_t slot = b % trace->blocks;
+        unsigned char *block = trace->ring + (size_t)slot * TRACE_BLOCK;
+        uint32_t fill = b == newest ? (uint32_t)(trace->cur - block) : trace->fill[slot];
+        fwrite(&fill, sizeof(fill), 1, fp);
+        fwrite(block, 1, fill, fp);
+    }
+
+    if (ferror(fp) || fclose(fp) != 0 || rename(partial, trace->path) != 0){
+        fprintf(stderr, "Error writing trace %s.\n", trace->path);
+        exit(1);
+    }
+    free(partial);
+}
+/**********************************************************************/
+//Function request is the handler for TRACE_SIGNAL
+static void request(int signal){
+    (void)signal;
+    Trace_requested = 1;
+}
+/**********************************************************************/
+extern void Trace_watch(void){
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(TRACE_SIGNAL, &action, NULL);
+}
+/**********************************************************************/
+extern void Trace_free(Trace *trace){
+    free(trace->ring);
+    free(trace->fill);
+}
+/**********************************************************************/
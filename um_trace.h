@@ -0,0 +1,127 @@
+//Timothy Colaneri
+//Universal Machine instruction trace interface
+
+/**********************************************************************/
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+#include <signal.h>
+#include <inttypes.h>
+/**********************************************************************/
+//A trace is a stream of bytes recording every instruction run, by its
+//opcode and PC, and the events that change memory. It is kept in a
+//ring of TRACE_BLOCK byte blocks, the oldest of which the newest
+//overwrites, so a trace left on for hours holds its last stretch.
+//Each block starts with a TRACE_KEY record holding the PC and the
+//instruction count, so the blocks decode one at a time. Then come
+//records, each a tag byte and any varints it is followed by:
+//  TRACE_STEP | opcode     the instruction at the PC after the last
+//  TRACE_JUMP | opcode     an instruction elsewhere, then the distance
+//                          from the PC after the last, zigzag coded
+//  TRACE_MAP               the ID and length of a mapped segment
+//  TRACE_UNMAP             the ID of an unmapped segment
+//  TRACE_STORE             the offset of a store into segment 0
+//  TRACE_LOAD              the segment a load program copied
+//  TRACE_KEY               the PC and the count of instructions so far
+//A varint holds seven bits a byte, lowest first, with the top bit set
+//on every byte but the last. An event follows the record of the
+//instruction that made it.
+#define TRACE_STEP  0x00
+#define TRACE_JUMP  0x10
+#define TRACE_MAP   0x20
+#define TRACE_UNMAP 0x30
+#define TRACE_STORE 0x40
+#define TRACE_LOAD  0x50
+#define TRACE_KEY   0xf0
+#define TRACE_BLOCK 4096
+#define TRACE_RECORD 32
+#define TRACE_SIZE  (64u << 20) //ring bytes unless asked otherwise
+
+//A Trace is the recorder Interp_prog_traced writes to. 'cur' is where
+//the next record goes in the current block, and a record that would
+//go past 'limit' starts the next block instead. 'expect' is the PC
+//of the instruction after the last, and 'count' the instructions
+//recorded so far. 'fill' holds the bytes used in each block of the
+//ring, and 'started' counts the blocks started since the beginning.
+typedef struct Trace {
+    unsigned char *ring;
+    uint32_t *fill;
+    uint32_t blocks;
+    uint64_t started;
+    unsigned char *cur, *limit;
+    uint32_t expect;
+    uint64_t count;
+    const char *path;
+} Trace;
+
+//A trace file is a Trace_header followed by the blocks of the ring,
+//oldest first, each as its length in bytes and then those bytes. The
+//file is in the byte order of the machine that wrote it, which the
+//header records like a snapshot's does. Blocks the ring overwrote
+//are counted in the header, but are gone.
+typedef struct Trace_header {
+    char magic[8];      //TRACE_MAGIC with its NUL
+    uint32_t order;     //TRACE_ORDER
+    uint32_t blockSize;
+    uint32_t blocks;    //blocks in the file
+    int32_t status;     //how the machine stopped, as an Interp_status
+    uint32_t pc;        //and where
+    uint32_t unused;
+    uint64_t count;     //instructions recorded
+    uint64_t dropped;   //blocks overwritten before the file was written
+} Trace_header;
+#define TRACE_MAGIC "UMTRACE"
+#define TRACE_ORDER 0x01020304u
+
+//Trace_requested is set when TRACE_SIGNAL arrives, once Trace_watch
+//has been called. Interp_prog_traced writes the trace on it.
+extern volatile sig_atomic_t Trace_requested;
+#define TRACE_SIGNAL SIGQUIT
+/**********************************************************************/
+extern void Trace_init(Trace *trace, const char *path, size_t bytes);
+//Trace_init sets up 'trace' to record into a ring of 'bytes' bytes,
+//rounded to whole blocks, and to be written to the file 'path'
+extern void Trace_block(Trace *trace);
+//Trace_block ends the current block and starts the next, overwriting
+//the oldest once the ring is full
+extern void Trace_write(Trace *trace, int status, uint32_t pc);
+//Trace_write writes the blocks in the ring to the file of 'trace',
+//oldest first, along with the status the machine stopped with, or
+//INTERP_STOPPED while it still runs, and its PC. The trace carries on
+//recording after.
+extern void Trace_watch(void);
+//Trace_watch sets Trace_requested whenever TRACE_SIGNAL arrives
+extern void Trace_free(Trace *trace);
+//Trace_free frees the ring of 'trace'
+/**********************************************************************/
+//These append records. Trace_step records the instruction with
+//opcode 'opcode' at 'pc', which is where Trace_block is called from;
+//a block keeps TRACE_RECORD bytes past 'limit', enough for a step
+//and its event.
+static inline void Trace_varint(Trace *trace, uint64_t value){
+    while (value >= 0x80){
+        *trace->cur++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *trace->cur++ = (unsigned char)value;
+}
+static inline void Trace_step(Trace *trace, uint32_t pc, unsigned opcode){
+    if (trace->cur >= trace->limit){
+        Trace_block(trace);
+    }
+    if (pc == trace->expect){
+        *trace->cur++ = TRACE_STEP | opcode;
+    }
+    else{
+        int32_t distance = (int32_t)(pc - trace->expect);
+        *trace->cur++ = TRACE_JUMP | opcode;
+        Trace_varint(trace, ((uint32_t)distance << 1) ^ (uint32_t)(distance >> 31));
+    }
+    trace->expect = pc + 1;
+    ++trace->count;
+}
+static inline void Trace_event(Trace *trace, unsigned tag, uint32_t value){
+    *trace->cur++ = tag;
+    Trace_varint(trace, value);
+}
+/**********************************************************************/
+#endif
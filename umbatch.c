@@ -0,0 +1,490 @@
+//Timothy Colaneri
+//Universal Machine batch runner
+
+/* umbatch runs every job of a manifest on a pool of worker threads,
+each job a Machine_T of its own. The jobs are dealt out to the
+workers in manifest order, a contiguous share each, onto a deque per
+worker. A worker takes its own jobs from the front of its deque and,
+once that is empty, steals from the back of the others', so a worker
+that drew long jobs has its last ones taken over by the workers that
+finished early. Every deque has its own lock, which only a thief
+ever contends for. No job is added once the pool starts, so a worker
+that finds every deque empty is done.
+
+A worker's machines allocate their segments under MEMSEG_ARENA by
+default, so each job carves its memory out of chunks of its own that
+only that worker's thread touches, and frees them all at once when
+the job ends. */
+
+/**********************************************************/
+#define _POSIX_C_SOURCE 200809L //clock_gettime, sysconf
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include<pthread.h>
+#include"um_machine.h"
+/**********************************************************/
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+//A File is an image or input file named in the manifest,
+//read into memory once however many jobs name it
+typedef struct File {
+    char *path;
+    unsigned char *bytes;
+    size_t size;
+} File;
+
+//A Job is one line of the manifest, and once it has run, its
+//outcome. input is -1 for a job that gets no input.
+typedef struct Job {
+    int image, input;
+    Machine_status status;
+    const char *fault;
+    uint32_t pc;
+    double seconds;
+    uint64_t checksum, bytes;
+    int worker;
+} Job;
+
+//A Deque holds the jobs jobs[front] to jobs[back - 1] that
+//are still waiting for a worker
+typedef struct Deque {
+    pthread_mutex_t lock;
+    int *jobs;
+    int front, back;
+} Deque;
+
+//A Pool is everything the workers share
+typedef struct Pool {
+    File *files;
+    Job *jobs;
+    Deque *deques;
+    int workers;
+    Machine_engine engine;
+    Memseg_alloc policy;
+} Pool;
+
+//A Worker is one thread of the pool, with its counters
+typedef struct Worker {
+    Pool *pool;
+    int id;
+    pthread_t thread;
+    int ran, stolen;
+    double busy;
+} Worker;
+
+//A Stream is the input and output of one job
+typedef struct Stream {
+    const unsigned char *next;
+    size_t left;
+    uint64_t checksum, bytes;
+} Stream;
+/**********************************************************/
+//Function now returns the monotonic clock in seconds
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/**********************************************************/
+//Function read_file reads the whole file at 'path' into 'file'
+static void read_file(const char *path, File *file){
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening file %s.\n", path);
+        exit(1);
+    }
+    size_t capacity = 1 << 16, used = 0, got;
+    unsigned char *bytes = malloc(capacity);
+    while (bytes != NULL &&
+           (got = fread(bytes + used, 1, capacity - used, fp)) > 0){
+        used += got;
+        if (used == capacity){
+            capacity *= 2;
+            bytes = realloc(bytes, capacity);
+        }
+    }
+    if (bytes == NULL){
+        fprintf(stderr, "Error, out of memory reading %s.\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    file->path = strdup(path);
+    file->bytes = bytes;
+    file->size = used;
+}
+/**********************************************************/
+//Function find_file returns the index of the file at 'path',
+//reading it in if no job has named it yet
+static int find_file(const char *path, File **files, int *count, int *capacity){
+    for (int i = 0; i < *count; ++i){
+        if (strcmp((*files)[i].path, path) == 0){
+            return i;
+        }
+    }
+    if (*count == *capacity){
+        *capacity *= 2;
+        *files = realloc(*files, *capacity * sizeof(File));
+        if (*files == NULL){
+            fprintf(stderr, "Error, out of memory.\n");
+            exit(1);
+        }
+    }
+    read_file(path, &(*files)[*count]);
+    return (*count)++;
+}
+/**********************************************************/
+//Function read_manifest reads the jobs of the manifest at
+//'path', one per line as an image path followed by an
+//optional input path. Blank lines and lines starting with #
+//are skipped.
+static Job *read_manifest(const char *path, File **files, int *fileCount,
+                          int *jobCount){
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening manifest %s.\n", path);
+        exit(1);
+    }
+    int capacity = 16, fileCapacity = 16;
+    Job *jobs = malloc(capacity * sizeof(Job));
+    *files = malloc(fileCapacity * sizeof(File));
+    *fileCount = *jobCount = 0;
+    if (jobs == NULL || *files == NULL){
+        fprintf(stderr, "Error, out of memory.\n");
+        exit(1);
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL){
+        char *image = strtok(line, " \t\r\n");
+        if (image == NULL || image[0] == '#'){
+            continue;
+        }
+        char *input = strtok(NULL, " \t\r\n");
+        if (*jobCount == capacity){
+            capacity *= 2;
+            jobs = realloc(jobs, capacity * sizeof(Job));
+            if (jobs == NULL){
+                fprintf(stderr, "Error, out of memory.\n");
+                exit(1);
+            }
+        }
+        Job *job = &jobs[(*jobCount)++];
+        memset(job, 0, sizeof(*job));
+        job->image = find_file(image, files, fileCount, &fileCapacity);
+        job->input = input == NULL ? -1
+                   : find_file(input, files, fileCount, &fileCapacity);
+    }
+    if (fp != stdin){
+        fclose(fp);
+    }
+    return jobs;
+}
+/**********************************************************/
+//Functions read_input and write_output are the callbacks of
+//a job's machine. The output only goes into a checksum.
+static size_t read_input(void *cl, unsigned char *buffer, size_t size){
+    Stream *stream = cl;
+    size_t n = size < stream->left ? size : stream->left;
+    memcpy(buffer, stream->next, n);
+    stream->next += n;
+    stream->left -= n;
+    return n;
+}
+static void write_output(void *cl, const unsigned char *bytes, size_t size){
+    Stream *stream = cl;
+    uint64_t checksum = stream->checksum;
+    for (size_t i = 0; i < size; ++i){
+        checksum = (checksum ^ bytes[i]) * FNV_PRIME;
+    }
+    stream->checksum = checksum;
+    stream->bytes += size;
+}
+/**********************************************************/
+//Function run_job runs 'job' to completion on a machine of
+//its own and records how it went
+static void run_job(Worker *worker, Job *job){
+    Pool *pool = worker->pool;
+    File *image = &pool->files[job->image];
+    Stream stream = { NULL, 0, FNV_OFFSET, 0 };
+    if (job->input >= 0){
+        stream.next = pool->files[job->input].bytes;
+        stream.left = pool->files[job->input].size;
+    }
+
+    double start = now();
+    Machine_T machine = Machine_new(image->bytes, image->size, pool->engine,
+                                    pool->policy);
+    Machine_io(machine, read_input, write_output, &stream);
+    job->status = Machine_run(machine);
+    job->fault = Machine_fault(machine);
+    job->pc = Machine_pc(machine);
+    Machine_free(machine);
+    job->seconds = now() - start;
+
+    job->checksum = stream.checksum;
+    job->bytes = stream.bytes;
+    job->worker = worker->id;
+    worker->busy += job->seconds;
+    ++worker->ran;
+}
+/**********************************************************/
+//Function take removes the front job of 'deque', returning
+//-1 if it is empty
+static int take(Deque *deque){
+    int job = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->front < deque->back){
+        job = deque->jobs[deque->front++];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+//Function steal removes the back job of the first deque after
+//the worker's own that has one, returning -1 if none has
+static int steal(Worker *worker){
+    Pool *pool = worker->pool;
+    for (int i = 1; i < pool->workers; ++i){
+        Deque *deque = &pool->deques[(worker->id + i) % pool->workers];
+        int job = -1;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->front < deque->back){
+            job = deque->jobs[--deque->back];
+        }
+        pthread_mutex_unlock(&deque->lock);
+        if (job >= 0){
+            ++worker->stolen;
+            return job;
+        }
+    }
+    return -1;
+}
+/**********************************************************/
+//Function work is the body of each worker thread
+static void *work(void *cl){
+    Worker *worker = cl;
+    Deque *own = &worker->pool->deques[worker->id];
+    int job;
+    while ((job = take(own)) >= 0 || (job = steal(worker)) >= 0){
+        run_job(worker, &worker->pool->jobs[job]);
+    }
+    return NULL;
+}
+/**********************************************************/
+//Function run_pool runs every job on 'workers' threads,
+//filling in the counters of 'pool's workers, and returns the
+//wall clock seconds the batch took
+static double run_pool(Pool *pool, Worker *workers, int jobCount){
+    int *order = malloc((jobCount + 1) * sizeof(int));
+    if (order == NULL){
+        fprintf(stderr, "Error, out of memory.\n");
+        exit(1);
+    }
+    for (int i = 0; i < jobCount; ++i){
+        order[i] = i;
+    }
+
+    //Deal the jobs out in contiguous shares
+    for (int w = 0; w < pool->workers; ++w){
+        Deque *deque = &pool->deques[w];
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->jobs = order;
+        deque->front = (int)((long)jobCount * w / pool->workers);
+        deque->back = (int)((long)jobCount * (w + 1) / pool->workers);
+        workers[w].pool = pool;
+        workers[w].id = w;
+        workers[w].ran = workers[w].stolen = 0;
+        workers[w].busy = 0;
+    }
+
+    double start = now();
+    for (int w = 0; w < pool->workers; ++w){
+        if (pthread_create(&workers[w].thread, NULL, work, &workers[w]) != 0){
+            fprintf(stderr, "Error starting worker %d.\n", w);
+            exit(1);
+        }
+    }
+    for (int w = 0; w < pool->workers; ++w){
+        pthread_join(workers[w].thread, NULL);
+    }
+    double wall = now() - start;
+
+    for (int w = 0; w < pool->workers; ++w){
+        pthread_mutex_destroy(&pool->deques[w].lock);
+    }
+    free(order);
+    return wall;
+}
+/**********************************************************/
+//Function write_jobs lists each job with its outcome
+static void write_jobs(FILE *out, const Pool *pool, int jobCount){
+    fprintf(out, "%5s  %-24s %-16s %-8s %6s %10s %12s  %s\n", "job",
+            "image", "input", "status", "worker", "seconds", "output",
+            "checksum");
+    for (int i = 0; i < jobCount; ++i){
+        const Job *job = &pool->jobs[i];
+        fprintf(out, "%5d  %-24s %-16s %-8s %6d %10.4f %12" PRIu64
+                     "  %016" PRIx64, i + 1, pool->files[job->image].path,
+                job->input >= 0 ? pool->files[job->input].path : "-",
+                job->status == MACHINE_HALTED ? "halted" : "faulted",
+                job->worker, job->seconds, job->bytes, job->checksum);
+        if (job->status != MACHINE_HALTED){
+            fprintf(out, "  %s at pc %" PRIu32, job->fault, job->pc);
+        }
+        fprintf(out, "\n");
+    }
+}
+/**********************************************************/
+//Function write_workers sums up one run of the pool
+static void write_workers(FILE *out, const Worker *workers, int count,
+                          int jobCount, double wall){
+    double busy = 0;
+    int stolen = 0;
+    for (int w = 0; w < count; ++w){
+        busy += workers[w].busy;
+        stolen += workers[w].stolen;
+    }
+    fprintf(out, "\n%d jobs on %d workers in %.4f s: %.1f jobs/s, "
+                 "%d stolen, %.1f%% busy\n", jobCount, count, wall,
+            wall > 0 ? jobCount / wall : 0, stolen,
+            wall > 0 ? 100 * busy / (wall * count) : 0);
+    fprintf(out, "%6s %6s %6s %10s\n", "worker", "jobs", "stolen", "busy s");
+    for (int w = 0; w < count; ++w){
+        fprintf(out, "%6d %6d %6d %10.4f\n", w, workers[w].ran,
+                workers[w].stolen, workers[w].busy);
+    }
+}
+/**********************************************************/
+//This main function runs the jobs of the manifest named on
+//the command line, or of stdin for "-". Options come before
+//the manifest:
+//  --threads=N               workers, one per online CPU by
+//                            default
+//  --engine=switch|threaded|jit|checked
+//                            interpreter, checked by default;
+//                            under the others a job that
+//                            divides by zero or reaches outside
+//                            of its segments kills the whole
+//                            batch
+//  --alloc=malloc|slab|arena segment allocator, arena by default
+//  --repeat=N                run the manifest N times over
+//  --scaling                 run the batch on 1, 2, 4 ... up to
+//                            N workers and report the speedup
+//                            and efficiency of each against one
+//It exits with 1 if any job faulted.
+int main(int argc, char *argv[]){
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    Machine_engine engine = MACHINE_CHECKED;
+    Memseg_alloc policy = MEMSEG_ARENA;
+    int repeat = 1, scaling = 0;
+    int argi = 1;
+
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi){
+        if (strncmp(argv[argi], "--threads=", 10) == 0){
+            threads = atoi(argv[argi] + 10);
+        }
+        else if (strcmp(argv[argi], "--engine=switch") == 0){
+            engine = MACHINE_SWITCH;
+        }
+        else if (strcmp(argv[argi], "--engine=threaded") == 0){
+            engine = MACHINE_THREADED;
+        }
+        else if (strcmp(argv[argi], "--engine=jit") == 0){
+            engine = MACHINE_JIT;
+        }
+        else if (strcmp(argv[argi], "--engine=checked") == 0){
+            engine = MACHINE_CHECKED;
+        }
+        else if (strcmp(argv[argi], "--alloc=malloc") == 0){
+            policy = MEMSEG_MALLOC;
+        }
+        else if (strcmp(argv[argi], "--alloc=slab") == 0){
+            policy = MEMSEG_SLAB;
+        }
+        else if (strcmp(argv[argi], "--alloc=arena") == 0){
+            policy = MEMSEG_ARENA;
+        }
+        else if (strncmp(argv[argi], "--repeat=", 9) == 0){
+            repeat = atoi(argv[argi] + 9);
+        }
+        else if (strcmp(argv[argi], "--scaling") == 0){
+            scaling = 1;
+        }
+        else{
+            fprintf(stderr,"Error, unknown option %s.\n", argv[argi]);
+            exit(1);
+        }
+    }
+    if (argc - argi != 1 || threads < 1 || repeat < 1){
+        fprintf(stderr,"Error, incorrect arguments.\n");
+        exit(1);
+    }
+
+    Pool pool;
+    int fileCount, listed;
+    Job *listedJobs = read_manifest(argv[argi], &pool.files, &fileCount, &listed);
+    int jobCount = listed * repeat;
+    pool.jobs = malloc((jobCount + 1) * sizeof(Job));
+    pool.deques = malloc(threads * sizeof(Deque));
+    Worker *workers = malloc(threads * sizeof(Worker));
+    if (pool.jobs == NULL || pool.deques == NULL || workers == NULL){
+        fprintf(stderr, "Error, out of memory.\n");
+        exit(1);
+    }
+    for (int i = 0; i < jobCount; ++i){
+        pool.jobs[i] = listedJobs[i % listed];
+    }
+    pool.engine = engine;
+    pool.policy = policy;
+
+    //Each scaling run doubles the workers, ending on 'threads'
+    double single = 0;
+    if (scaling){
+        fprintf(stdout, "%7s %10s %10s %8s %10s\n", "workers", "wall s",
+                "jobs/s", "speedup", "efficiency");
+        for (int n = 1; n < threads; n *= 2){
+            pool.workers = n;
+            double wall = run_pool(&pool, workers, jobCount);
+            if (n == 1){
+                single = wall;
+            }
+            fprintf(stdout, "%7d %10.4f %10.1f %8.2f %9.1f%%\n", n, wall,
+                    wall > 0 ? jobCount / wall : 0, wall > 0 ? single / wall : 0,
+                    wall > 0 ? 100 * single / (wall * n) : 0);
+        }
+    }
+    pool.workers = threads;
+    double wall = run_pool(&pool, workers, jobCount);
+    if (scaling){
+        if (threads == 1){
+            single = wall;
+        }
+        fprintf(stdout, "%7d %10.4f %10.1f %8.2f %9.1f%%\n\n", threads, wall,
+                wall > 0 ? jobCount / wall : 0, wall > 0 ? single / wall : 0,
+                wall > 0 ? 100 * single / (wall * threads) : 0);
+    }
+
+    write_jobs(stdout, &pool, jobCount);
+    write_workers(stdout, workers, threads, jobCount, wall);
+
+    int faulted = 0;
+    for (int i = 0; i < jobCount; ++i){
+        faulted |= pool.jobs[i].status != MACHINE_HALTED;
+    }
+    for (int i = 0; i < fileCount; ++i){
+        free(pool.files[i].path);
+        free(pool.files[i].bytes);
+    }
+    free(pool.files);
+    free(listedJobs);
+    free(pool.jobs);
+    free(pool.deques);
+    free(workers);
+    return faulted;
+}
+/**********************************************************/
@@ -0,0 +1,399 @@
+//Timothy Colaneri
+//Universal Machine benchmark driver
+
+/**********************************************************/
+#define _POSIX_C_SOURCE 200809L //clock_gettime
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<math.h>
+#include<time.h>
+#include"um_load.h"
+#include"um_exec.h"
+/**********************************************************/
+//An Engine and an Alloc name one choice the um binary
+//offers on its command line
+typedef struct Engine {
+    const char *name;
+    Interp_status (*interp)(Memseg_T, unsigned *, uint32_t *, Umio_T);
+} Engine;
+typedef struct Alloc {
+    const char *name;
+    Memseg_alloc policy;
+} Alloc;
+
+static const Engine engines[] = {
+    { "switch", Interp_prog },
+    { "threaded", Interp_prog_threaded },
+    { "jit", Interp_prog_jit },
+    { "checked", Interp_prog_checked }
+};
+static const Alloc allocs[] = {
+    { "malloc", MEMSEG_MALLOC },
+    { "slab", MEMSEG_SLAB },
+    { "arena", MEMSEG_ARENA }
+};
+#define ENGINES (sizeof(engines) / sizeof(engines[0]))
+#define ALLOCS  (sizeof(allocs) / sizeof(allocs[0]))
+
+//A Result is the outcome of one image under one engine and
+//allocator. Times are wall clock seconds per run, loading
+//included. 'ok' is 0 if a run's output checksum differed
+//from the image's reference checksum or a run did not halt,
+//and 'faulted' is 1 in the second case.
+typedef struct Result {
+    const char *image;
+    const char *engine, *alloc;
+    int runs;
+    double median, p95, stddev, mean;
+    double ips;
+    uint64_t checksum;
+    int ok, faulted;
+    double baseline;  //baseline median, or 0 if there is none
+    int regressed;
+} Result;
+/**********************************************************/
+//Function now returns the monotonic clock in seconds
+static double now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/**********************************************************/
+//Function open_image opens the program image at 'path'
+static FILE *open_image(const char *path){
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening file %s.\n", path);
+        exit(1);
+    }
+    return fp;
+}
+/**********************************************************/
+//Function run_once loads and runs the image at 'path' under
+//'interp' and 'policy', returning its output checksum and
+//storing how the engine returned into 'status'. The output
+//only goes into the checksum, and the input comes from the
+//input log 'replay' unless it is NULL.
+static uint64_t run_once(const char *path,
+                         Interp_status (*interp)(Memseg_T, unsigned *, uint32_t *, Umio_T),
+                         Memseg_alloc policy, const char *replay,
+                         Interp_status *status){
+    FILE *fp = open_image(path);
+    Memseg_T program = Memseg_new(policy);
+    Load_prog(fp, program);
+    fclose(fp);
+
+    uint32_t registers[8] = { 0 };
+    uint32_t pc = 0;
+    Umio_T io = Umio_new(UMIO_CHECKSUM, NULL, UMIO_THRESHOLD);
+    if (replay != NULL){
+        Umio_replay(io, replay, NULL);
+    }
+    *status = interp(program, registers, &pc, io);
+    uint64_t bytes;
+    uint64_t checksum = Umio_checksum(io, &bytes);
+    Umio_free(io);
+    Memseg_free(program);
+    return checksum;
+}
+/**********************************************************/
+//Function reference runs the image once under the counting
+//engine, returning its checksum and storing the number of
+//instructions it executes into 'instructions'
+static uint64_t reference(const char *path, uint64_t *instructions, const char *replay){
+    FILE *fp = open_image(path);
+    Memseg_T program = Memseg_new(MEMSEG_SLAB);
+    Load_prog(fp, program);
+    fclose(fp);
+
+    Profile profile;
+    Profile_init(&profile, 0);
+    uint32_t registers[8] = { 0 };
+    uint32_t pc = 0;
+    Umio_T io = Umio_new(UMIO_CHECKSUM, NULL, UMIO_THRESHOLD);
+    if (replay != NULL){
+        Umio_replay(io, replay, NULL);
+    }
+    if (Interp_prog_counts(program, registers, &pc, io, &profile) != INTERP_HALTED){
+        fprintf(stderr, "Error, %s faulted at program counter %" PRIu32 ".\n", path, pc);
+        exit(1);
+    }
+    uint64_t bytes;
+    uint64_t checksum = Umio_checksum(io, &bytes);
+    *instructions = Profile_total(&profile);
+    Umio_free(io);
+    Profile_free(&profile);
+    Memseg_free(program);
+    return checksum;
+}
+/**********************************************************/
+//Function by_time orders run times from fastest to slowest
+static int by_time(const void *x, const void *y){
+    double a = *(const double *)x, b = *(const double *)y;
+    return (a > b) - (a < b);
+}
+//Function summarize fills in the statistics of 'result' from
+//the 'runs' times in 'times', which it sorts
+static void summarize(Result *result, double *times, int runs,
+                      uint64_t instructions){
+    qsort(times, runs, sizeof(double), by_time);
+    double sum = 0;
+    for (int i = 0; i < runs; ++i){
+        sum += times[i];
+    }
+    result->runs = runs;
+    result->mean = sum / runs;
+    result->median = runs % 2 ? times[runs / 2]
+                              : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    result->p95 = times[(int)ceil(0.95 * runs) - 1];
+
+    double squares = 0;
+    for (int i = 0; i < runs; ++i){
+        squares += (times[i] - result->mean) * (times[i] - result->mean);
+    }
+    result->stddev = runs > 1 ? sqrt(squares / (runs - 1)) : 0;
+    result->ips = result->median > 0 ? instructions / result->median : 0;
+}
+/**********************************************************/
+//Function find_baseline looks up the median of 'result' in
+//the baseline file, a CSV file written by --format=csv
+static double find_baseline(const char *path, const Result *result){
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening baseline %s.\n", path);
+        exit(1);
+    }
+    char line[1024];
+    double median = 0;
+    while (fgets(line, sizeof(line), fp) != NULL){
+        char image[512], engine[32], alloc[32];
+        int runs;
+        double value;
+        if (sscanf(line, "%511[^,],%31[^,],%31[^,],%d,%lf", image, engine,
+                   alloc, &runs, &value) == 5 &&
+            strcmp(image, result->image) == 0 &&
+            strcmp(engine, result->engine) == 0 &&
+            strcmp(alloc, result->alloc) == 0){
+            median = value;
+        }
+    }
+    fclose(fp);
+    return median;
+}
+/**********************************************************/
+//These write the results in each of the formats
+static void write_text(FILE *out, const Result *results, int count){
+    fprintf(out, "%-20s %-9s %-7s %5s %9s %9s %9s %11s  %s\n", "image",
+            "engine", "alloc", "runs", "median s", "p95 s", "stddev s",
+            "MIPS", "status");
+    for (int i = 0; i < count; ++i){
+        const Result *r = &results[i];
+        fprintf(out, "%-20s %-9s %-7s %5d %9.4f %9.4f %9.4f %11.1f  %s",
+                r->image, r->engine, r->alloc, r->runs, r->median, r->p95,
+                r->stddev, r->ips / 1e6, r->faulted ? "FAULTED"
+                : !r->ok ? "CHECKSUM MISMATCH"
+                : r->regressed ? "REGRESSED" : "ok");
+        if (r->baseline > 0){
+            fprintf(out, " (%+.1f%% against baseline)",
+                    100 * (r->median / r->baseline - 1));
+        }
+        fprintf(out, "\n");
+    }
+}
+static void write_csv(FILE *out, const Result *results, int count){
+    fprintf(out, "image,engine,alloc,runs,median_s,p95_s,stddev_s,mean_s,"
+                 "ips,checksum,ok,baseline_s,regressed\n");
+    for (int i = 0; i < count; ++i){
+        const Result *r = &results[i];
+        fprintf(out, "%s,%s,%s,%d,%.6f,%.6f,%.6f,%.6f,%.0f,%016" PRIx64
+                     ",%d,%.6f,%d\n", r->image, r->engine, r->alloc, r->runs,
+                r->median, r->p95, r->stddev, r->mean, r->ips, r->checksum,
+                r->ok, r->baseline, r->regressed);
+    }
+}
+static void write_json(FILE *out, const Result *results, int count){
+    fprintf(out, "[\n");
+    for (int i = 0; i < count; ++i){
+        const Result *r = &results[i];
+        fprintf(out, "  {\"image\": \"%s\", \"engine\": \"%s\", \"alloc\": \"%s\", "
+                     "\"runs\": %d, \"median_s\": %.6f, \"p95_s\": %.6f, "
+                     "\"stddev_s\": %.6f, \"mean_s\": %.6f, \"ips\": %.0f, "
+                     "\"checksum\": \"%016" PRIx64 "\", \"ok\": %s, "
+                     "\"baseline_s\": %.6f, \"regressed\": %s}%s\n",
+                r->image, r->engine, r->alloc, r->runs, r->median, r->p95,
+                r->stddev, r->mean, r->ips, r->checksum,
+                r->ok ? "true" : "false", r->baseline,
+                r->regressed ? "true" : "false", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+/**********************************************************/
+//This main function benchmarks each image named on the
+//command line under every engine and allocator, or those
+//chosen with the options that come before the images:
+//  --runs=N                  timed runs of each, 5 by default
+//  --warmup=N                untimed runs first, 1 by default
+//  --engine=NAME             only this engine
+//  --alloc=NAME              only this allocator
+//  --format=text|csv|json    result format, text by default
+//  --out=FILE                write the results to FILE
+//  --baseline=FILE           compare medians with a CSV file
+//                            written earlier by --format=csv
+//  --threshold=PERCENT       slowdown that counts as a
+//                            regression, 10 by default
+//  --replay=FILE             feed every run the input log FILE,
+//                            written by um --record, in place of
+//                            stdin, so interactive images repeat
+//                            the same session each run
+//It exits with 1 if an output checksum was wrong or a run
+//faulted, and with 2 if a median regressed against the
+//baseline.
+int main(int argc, char *argv[]){
+
+    int runs = 5, warmup = 1;
+    const char *onlyEngine = NULL, *onlyAlloc = NULL;
+    const char *format = "text", *outPath = NULL, *baseline = NULL;
+    const char *replay = NULL;
+    double threshold = 10;
+    int argi = 1;
+
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi){
+        if (strncmp(argv[argi], "--runs=", 7) == 0){
+            runs = atoi(argv[argi] + 7);
+        }
+        else if (strncmp(argv[argi], "--warmup=", 9) == 0){
+            warmup = atoi(argv[argi] + 9);
+        }
+        else if (strncmp(argv[argi], "--engine=", 9) == 0){
+            onlyEngine = argv[argi] + 9;
+        }
+        else if (strncmp(argv[argi], "--alloc=", 8) == 0){
+            onlyAlloc = argv[argi] + 8;
+        }
+        else if (strncmp(argv[argi], "--format=", 9) == 0){
+            format = argv[argi] + 9;
+        }
+        else if (strncmp(argv[argi], "--out=", 6) == 0){
+            outPath = argv[argi] + 6;
+        }
+        else if (strncmp(argv[argi], "--baseline=", 11) == 0){
+            baseline = argv[argi] + 11;
+        }
+        else if (strncmp(argv[argi], "--threshold=", 12) == 0){
+            threshold = atof(argv[argi] + 12);
+        }
+        else if (strncmp(argv[argi], "--replay=", 9) == 0){
+            replay = argv[argi] + 9;
+        }
+        else{
+            fprintf(stderr,"Error, unknown option %s.\n", argv[argi]);
+            exit(1);
+        }
+    }
+    if (argi == argc || runs < 1 || warmup < 0 ||
+        (strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 &&
+         strcmp(format, "json") != 0)){
+        fprintf(stderr,"Error, incorrect arguments.\n");
+        exit(1);
+    }
+    size_t e = 0, a = 0;
+    while (onlyEngine != NULL && e < ENGINES && strcmp(onlyEngine, engines[e].name) != 0){
+        ++e;
+    }
+    while (onlyAlloc != NULL && a < ALLOCS && strcmp(onlyAlloc, allocs[a].name) != 0){
+        ++a;
+    }
+    if (e == ENGINES || a == ALLOCS){
+        fprintf(stderr,"Error, unknown engine or allocator.\n");
+        exit(1);
+    }
+
+    int images = argc - argi;
+    Result *results = calloc((size_t)images * ENGINES * ALLOCS, sizeof(Result));
+    double *times = malloc(runs * sizeof(double));
+    if (results == NULL || times == NULL){
+        fprintf(stderr,"Error, out of memory.\n");
+        exit(1);
+    }
+    int count = 0, failed = 0, regressed = 0;
+
+    for (; argi < argc; ++argi){
+        const char *path = argv[argi];
+        uint64_t instructions;
+        uint64_t expected = reference(path, &instructions, replay);
+
+        for (size_t e = 0; e < ENGINES; ++e){
+            if (onlyEngine != NULL && strcmp(onlyEngine, engines[e].name) != 0){
+                continue;
+            }
+            for (size_t a = 0; a < ALLOCS; ++a){
+                if (onlyAlloc != NULL && strcmp(onlyAlloc, allocs[a].name) != 0){
+                    continue;
+                }
+                Result *result = &results[count++];
+                result->image = path;
+                result->engine = engines[e].name;
+                result->alloc = allocs[a].name;
+                result->checksum = expected;
+                result->ok = 1;
+                fprintf(stderr, "%s %s %s\n", path, result->engine, result->alloc);
+
+                for (int i = 0; i < warmup + runs; ++i){
+                    Interp_status status;
+                    double start = now();
+                    uint64_t checksum = run_once(path, engines[e].interp,
+                                                 allocs[a].policy, replay,
+                                                 &status);
+                    double elapsed = now() - start;
+                    if (status != INTERP_HALTED){
+                        result->ok = 0;
+                        result->faulted = 1;
+                    }
+                    if (checksum != expected){
+                        result->ok = 0;
+                        result->checksum = checksum;
+                    }
+                    if (i >= warmup){
+                        times[i - warmup] = elapsed;
+                    }
+                }
+                summarize(result, times, runs, instructions);
+
+                if (baseline != NULL){
+                    result->baseline = find_baseline(baseline, result);
+                    result->regressed = result->baseline > 0 &&
+                        result->median > result->baseline * (1 + threshold / 100);
+                }
+                failed |= !result->ok;
+                regressed |= result->regressed;
+            }
+        }
+    }
+
+    FILE *out = stdout;
+    if (outPath != NULL){
+        out = fopen(outPath, "w");
+        if (out == NULL){
+            fprintf(stderr,"Error opening file %s.\n", outPath);
+            exit(1);
+        }
+    }
+    if (strcmp(format, "csv") == 0){
+        write_csv(out, results, count);
+    }
+    else if (strcmp(format, "json") == 0){
+        write_json(out, results, count);
+    }
+    else{
+        write_text(out, results, count);
+    }
+    if (out != stdout){
+        fclose(out);
+    }
+
+    free(times);
+    free(results);
+    return failed ? 1 : regressed ? 2 : 0;
+}
+/**********************************************************/
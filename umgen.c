@@ -0,0 +1,665 @@
+//Timothy Colaneri
+//Universal Machine synthetic workload generator
+
+/* umgen writes .um images that each stress one part of the machine:
+a tight loop around one opcode, a storm of maps and unmaps with
+chosen segment sizes, streaming stores and loads through one large
+segment, or far load programs between segments of a chosen size.
+Every image prints a checksum of its work as eight letters 'a' to
+'p', one per hex digit, and a newline. umgen runs each image it
+writes through a small reference interpreter of its own and writes
+that output next to the image, as IMAGE.expected, so the images
+double as regression tests (see the 'regress' script).
+
+Registers in generated code: r0 always holds 0, r1 counts down the
+iterations of the main loop, and r6 and r7 are clobbered by branches
+and large constants. The workloads use r2 to r5. */
+
+/**********************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<inttypes.h>
+#include<assert.h>
+/**********************************************************/
+//An Asm is an image being assembled. Labels are addresses
+//in segment 0; 'fixups' are load value words whose value is
+//the label they name, to be filled in once it is placed.
+typedef struct Asm {
+    uint32_t *words;
+    uint32_t count, capacity;
+    uint32_t labels[64];
+    uint32_t labelCount;
+    struct { uint32_t at, label; } fixups[256];
+    uint32_t fixupCount;
+} Asm;
+
+enum { CMOV, LOAD, STORE, ADD, MULT, DIV, NAND, HALT,
+       MAP, UNMAP, OUT, IN, LOADPROG, LOADVAL };
+
+#define LV_MAX (1u << 25)  //load value immediates stay below this
+/**********************************************************/
+//These append instructions to an image
+static void word(Asm *a, uint32_t w){
+    if (a->count == a->capacity){
+        a->capacity = 2 * a->capacity + 1024;
+        a->words = realloc(a->words, a->capacity * sizeof(uint32_t));
+        assert(a->words);
+    }
+    a->words[a->count++] = w;
+}
+static void op(Asm *a, unsigned opcode, unsigned ra, unsigned rb, unsigned rc){
+    word(a, (uint32_t)opcode << 28 | ra << 6 | rb << 3 | rc);
+}
+static void lv(Asm *a, unsigned ra, uint32_t value){
+    assert(value < LV_MAX);
+    word(a, (uint32_t)LOADVAL << 28 | ra << 25 | value);
+}
+//Function constant loads any 32 bit value into 'ra', using
+//'scratch' if it does not fit a load value
+static void constant(Asm *a, unsigned ra, uint32_t value, unsigned scratch){
+    if (value < LV_MAX){
+        lv(a, ra, value);
+        return;
+    }
+    lv(a, ra, value >> 16);
+    lv(a, scratch, 1 << 16);
+    op(a, MULT, ra, ra, scratch);
+    lv(a, scratch, value & 0xFFFF);
+    op(a, ADD, ra, ra, scratch);
+}
+//Function and computes ra = rb & rc out of two nands
+static void and(Asm *a, unsigned ra, unsigned rb, unsigned rc){
+    op(a, NAND, ra, rb, rc);
+    op(a, NAND, ra, ra, ra);
+}
+//Function decrement subtracts one from 'ra', using r7
+static void decrement(Asm *a, unsigned ra){
+    op(a, NAND, 7, 0, 0);
+    op(a, ADD, ra, ra, 7);
+}
+/**********************************************************/
+//These create, place and refer to labels
+static uint32_t label(Asm *a){
+    assert(a->labelCount < 64);
+    a->labels[a->labelCount] = UINT32_MAX;
+    return a->labelCount++;
+}
+static void place(Asm *a, uint32_t l){
+    a->labels[l] = a->count;
+}
+static void lv_label(Asm *a, unsigned ra, uint32_t l){
+    assert(a->fixupCount < 256);
+    a->fixups[a->fixupCount].at = a->count;
+    a->fixups[a->fixupCount].label = l;
+    ++a->fixupCount;
+    lv(a, ra, 0);
+}
+//Function branch continues in segment 'rseg' at label 'l'
+//if 'rcond' is not zero, and falls through otherwise
+static void branch(Asm *a, unsigned rcond, uint32_t l, unsigned rseg){
+    uint32_t next = label(a);
+    lv_label(a, 6, l);
+    lv_label(a, 7, next);
+    op(a, CMOV, 7, 6, rcond);
+    if (rseg == 0){
+        op(a, LOADPROG, 0, 0, 7);
+    }
+    else{
+        //Fall through stays in segment 0, so the segment is
+        //chosen the same way as the target; r6 is free again
+        lv(a, 6, 0);
+        op(a, CMOV, 6, rseg, rcond);
+        op(a, LOADPROG, 0, 6, 7);
+    }
+    place(a, next);
+}
+//Function loop_end counts r1 down and goes back to 'top'
+//until it reaches zero
+static void loop_end(Asm *a, uint32_t top){
+    decrement(a, 1);
+    branch(a, 1, top, 0);
+}
+//Function print_hex outputs 'ra' as eight letters 'a' to 'p',
+//most significant digit first, and a newline, using r2, r6
+//and r7. 'ra' must not be one of those.
+static void print_hex(Asm *a, unsigned ra){
+    for (int shift = 28; shift >= 0; shift -= 4){
+        constant(a, 6, 1u << shift, 7);
+        op(a, DIV, 2, ra, 6);
+        lv(a, 6, 15);
+        and(a, 2, 2, 6);
+        lv(a, 6, 'a');
+        op(a, ADD, 2, 2, 6);
+        op(a, OUT, 0, 0, 2);
+    }
+    lv(a, 2, '\n');
+    op(a, OUT, 0, 0, 2);
+}
+//Function finish fills in the labels
+static void finish(Asm *a){
+    for (uint32_t i = 0; i < a->fixupCount; ++i){
+        uint32_t target = a->labels[a->fixups[i].label];
+        assert(target != UINT32_MAX && target < LV_MAX);
+        a->words[a->fixups[i].at] |= target;
+    }
+}
+/**********************************************************/
+//A Params holds the name=value parameters of a workload
+typedef struct Params {
+    int count;
+    char **names, **values;
+} Params;
+
+//Function param returns parameter 'name' as a number, or
+//'fallback' if it was not given
+static uint32_t param(Params *p, const char *name, uint32_t fallback){
+    for (int i = 0; i < p->count; ++i){
+        if (strcmp(p->names[i], name) == 0){
+            return (uint32_t)strtoul(p->values[i], NULL, 0);
+        }
+    }
+    return fallback;
+}
+//Function param_text returns parameter 'name' as text
+static const char *param_text(Params *p, const char *name, const char *fallback){
+    for (int i = 0; i < p->count; ++i){
+        if (strcmp(p->names[i], name) == 0){
+            return p->values[i];
+        }
+    }
+    return fallback;
+}
+/**********************************************************/
+//Function gen_arith loops 'iters' times over 'unroll' copies
+//of one opcode, op=add|mult|div|nand|cmov|loadval|load|store,
+//with r3 carrying the result from one to the next
+static void gen_arith(Asm *a, Params *p){
+    const char *name = param_text(p, "op", "add");
+    uint32_t iters = param(p, "iters", 1000000);
+    uint32_t unroll = param(p, "unroll", 16);
+    uint32_t top = label(a);
+
+    constant(a, 3, 12345, 7);
+    constant(a, 4, 0x9E3779B9u, 7);
+    lv(a, 5, 3);
+    if (strcmp(name, "load") == 0){
+        //r5 is a ring of 1024 words where word i holds the
+        //index of the next one to visit
+        lv(a, 2, 1024);
+        op(a, MAP, 0, 5, 2);
+        lv(a, 1, 1024);
+        uint32_t fill = label(a);
+        place(a, fill);
+        decrement(a, 1);
+        lv(a, 2, 389);
+        op(a, MULT, 2, 1, 2);
+        lv(a, 4, 1);
+        op(a, ADD, 2, 2, 4);
+        lv(a, 4, 1023);
+        and(a, 2, 2, 4);
+        op(a, STORE, 5, 1, 2);
+        branch(a, 1, fill, 0);
+        lv(a, 3, 0);
+    }
+    else if (strcmp(name, "store") == 0){
+        lv(a, 2, 64);
+        op(a, MAP, 0, 5, 2);
+    }
+
+    constant(a, 1, iters, 7);
+    place(a, top);
+    for (uint32_t u = 0; u < unroll; ++u){
+        if (strcmp(name, "add") == 0){
+            op(a, ADD, 3, 3, 4);
+        }
+        else if (strcmp(name, "mult") == 0){
+            op(a, MULT, 3, 3, 4);
+        }
+        else if (strcmp(name, "div") == 0){
+            op(a, DIV, 2, 3, 5);
+            op(a, ADD, 3, 2, 4);
+        }
+        else if (strcmp(name, "nand") == 0){
+            op(a, NAND, 3, 3, 4);
+        }
+        else if (strcmp(name, "cmov") == 0){
+            op(a, CMOV, 2, 3, 5);
+            op(a, CMOV, 3, 4, 5);
+            op(a, CMOV, 4, 2, 5);
+        }
+        else if (strcmp(name, "loadval") == 0){
+            lv(a, 3, (u * 7919 + 1) % LV_MAX);
+        }
+        else if (strcmp(name, "load") == 0){
+            op(a, LOAD, 3, 5, 3);
+        }
+        else if (strcmp(name, "store") == 0){
+            lv(a, 2, u % 64);
+            op(a, STORE, 5, 2, 3);
+            op(a, ADD, 3, 3, 4);
+        }
+        else{
+            fprintf(stderr, "Error, unknown op %s.\n", name);
+            exit(1);
+        }
+    }
+    loop_end(a, top);
+    if (strcmp(name, "store") == 0){
+        //Fold the stored words back in
+        for (uint32_t u = 0; u < 64 && u < unroll; ++u){
+            lv(a, 2, u);
+            op(a, LOAD, 2, 5, 2);
+            op(a, ADD, 3, 3, 2);
+        }
+    }
+    print_hex(a, 3);
+    op(a, HALT, 0, 0, 0);
+}
+/**********************************************************/
+//Function sizes fills 'table' with segment sizes drawn from
+//sizes=fixed:S, uniform:A:B or pow2:MAX, by a seeded LCG
+static void sizes(Params *p, uint32_t *table, uint32_t n){
+    const char *spec = param_text(p, "sizes", "uniform:1:64");
+    uint32_t seed = param(p, "seed", 1);
+    uint32_t x = 0, y = 0;
+
+    for (uint32_t i = 0; i < n; ++i){
+        seed = seed * 1103515245u + 12345u;
+        uint32_t r = seed >> 8;
+        if (sscanf(spec, "fixed:%" SCNu32, &x) == 1){
+            table[i] = x;
+        }
+        else if (sscanf(spec, "uniform:%" SCNu32 ":%" SCNu32, &x, &y) == 2 && x <= y){
+            table[i] = x + r % (y - x + 1);
+        }
+        else if (sscanf(spec, "pow2:%" SCNu32, &x) == 1 && x > 0){
+            uint32_t bits = 0;
+            while ((2u << bits) <= x){
+                ++bits;
+            }
+            table[i] = 1u << (r % (bits + 1));
+        }
+        else{
+            fprintf(stderr, "Error, bad sizes %s.\n", spec);
+            exit(1);
+        }
+        if (table[i] == 0){
+            table[i] = 1;
+        }
+    }
+}
+//Function gen_maps keeps 'window' segments mapped, a power of
+//two, and 'count' times unmaps one of them and maps a new one
+//in its place, its size taken from a table of 256 sizes. Each
+//segment holds the iteration that mapped it in word 0, which
+//is added up as it is unmapped.
+static void gen_maps(Asm *a, Params *p){
+    uint32_t count = param(p, "count", 1000000);
+    uint32_t window = param(p, "window", 16);
+    if (window == 0 || (window & (window - 1)) != 0 || window > 4096){
+        fprintf(stderr, "Error, window must be a power of two up to 4096.\n");
+        exit(1);
+    }
+    uint32_t handles = label(a), sum = label(a), table = label(a);
+    uint32_t top = label(a), done = label(a);
+
+    //Map the window, each segment with a 0 in word 0
+    lv(a, 2, window);
+    op(a, MAP, 0, 5, 2);
+    lv_label(a, 4, handles);
+    op(a, STORE, 0, 4, 5);
+    lv(a, 3, 1);
+    for (uint32_t slot = 0; slot < window; ++slot){
+        op(a, MAP, 0, 2, 3);
+        lv(a, 4, slot);
+        op(a, STORE, 5, 4, 2);
+    }
+
+    constant(a, 1, count, 7);
+    place(a, top);
+    lv(a, 3, window - 1);
+    and(a, 3, 1, 3);                //r3 = slot
+    lv_label(a, 4, handles);
+    op(a, LOAD, 5, 0, 4);           //r5 = window segment
+    op(a, LOAD, 4, 5, 3);           //r4 = old segment
+    op(a, LOAD, 2, 4, 0);           //r2 = its word 0
+    op(a, UNMAP, 0, 0, 4);
+    lv_label(a, 4, sum);
+    op(a, LOAD, 6, 0, 4);
+    op(a, ADD, 6, 6, 2);
+    op(a, STORE, 0, 4, 6);          //sum += r2
+    lv(a, 4, 255);
+    and(a, 4, 1, 4);
+    lv_label(a, 2, table);
+    op(a, ADD, 4, 4, 2);
+    op(a, LOAD, 4, 0, 4);           //r4 = next size
+    op(a, MAP, 0, 2, 4);
+    op(a, STORE, 2, 0, 1);          //word 0 = iteration
+    op(a, STORE, 5, 3, 2);
+    loop_end(a, top);
+
+    lv_label(a, 4, sum);
+    op(a, LOAD, 3, 0, 4);
+    print_hex(a, 3);
+    op(a, HALT, 0, 0, 0);
+
+    //Data
+    place(a, handles);
+    word(a, 0);
+    place(a, sum);
+    word(a, 0);
+    place(a, table);
+    uint32_t drawn[256];
+    sizes(p, drawn, 256);
+    for (int i = 0; i < 256; ++i){
+        word(a, drawn[i]);
+    }
+    place(a, done);
+}
+/**********************************************************/
+//Function gen_stream maps one segment of 'words' words and
+//'passes' times stores to every word, back to front, and then
+//adds every word up
+static void gen_stream(Asm *a, Params *p){
+    uint32_t words = param(p, "words", 1 << 20);
+    uint32_t passes = param(p, "passes", 16);
+    uint32_t top = label(a), stores = label(a), loads = label(a);
+    if (words == 0){
+        words = 1;
+    }
+
+    constant(a, 3, words, 7);
+    op(a, MAP, 0, 4, 3);
+    lv(a, 5, 0);
+    constant(a, 1, passes, 7);
+    place(a, top);
+
+    constant(a, 3, words, 7);
+    place(a, stores);
+    decrement(a, 3);
+    op(a, ADD, 2, 3, 1);
+    op(a, STORE, 4, 3, 2);
+    branch(a, 3, stores, 0);
+
+    constant(a, 3, words, 7);
+    place(a, loads);
+    decrement(a, 3);
+    op(a, LOAD, 2, 4, 3);
+    op(a, ADD, 5, 5, 2);
+    branch(a, 3, loads, 0);
+
+    loop_end(a, top);
+    print_hex(a, 5);
+    op(a, HALT, 0, 0, 0);
+}
+/**********************************************************/
+//Function gen_jumps pads segment 0 to 'size' words, copies it
+//to a new segment and then load programs that segment 'count'
+//times, each time replacing segment 0 with a segment of 'size'
+//words. With write=1 each round also stores into segment 0,
+//which forces a copy of a segment still shared.
+static void gen_jumps(Asm *a, Params *p){
+    uint32_t count = param(p, "count", 10000);
+    uint32_t size = param(p, "size", 4096);
+    uint32_t write = param(p, "write", 0);
+    uint32_t copy = label(a), top = label(a), scratch = label(a), end = label(a);
+
+    //r4 = a copy of segment 0
+    lv_label(a, 3, end);
+    op(a, MAP, 0, 4, 3);
+    place(a, copy);
+    decrement(a, 3);
+    op(a, LOAD, 2, 0, 3);
+    op(a, STORE, 4, 3, 2);
+    branch(a, 3, copy, 0);
+
+    lv(a, 5, 0);
+    constant(a, 1, count, 7);
+    place(a, top);
+    op(a, ADD, 5, 5, 1);
+    if (write){
+        lv_label(a, 3, scratch);
+        op(a, STORE, 0, 3, 5);
+    }
+    decrement(a, 1);
+    branch(a, 1, top, 4);
+    print_hex(a, 5);
+    op(a, HALT, 0, 0, 0);
+
+    place(a, scratch);
+    word(a, 0);
+    while (a->count < size){
+        word(a, 0);
+    }
+    place(a, end);
+}
+/**********************************************************/
+//A Segment of the reference interpreter
+typedef struct Seg {
+    uint32_t *words;
+    uint32_t length;
+} Seg;
+
+//Function reference runs an image with no input and returns
+//its output, storing the number of bytes into 'length'. It is
+//a plain interpreter, written apart from the um modules so
+//that it checks them.
+static char *reference(const uint32_t *image, uint32_t count, size_t *length){
+    uint32_t capacity = 1024, used = 1;
+    Seg *segs = calloc(capacity, sizeof(Seg));
+    uint32_t *free_ids = malloc(capacity * sizeof(uint32_t));
+    uint32_t freeCount = 0;
+    size_t outCount = 0, outCapacity = 256;
+    char *out = malloc(outCapacity);
+    uint32_t r[8] = { 0 };
+    uint32_t pc = 0;
+    assert(segs && free_ids && out);
+
+    segs[0].words = malloc((count + 1) * sizeof(uint32_t));
+    memcpy(segs[0].words, image, count * sizeof(uint32_t));
+    segs[0].length = count;
+
+    while (1){
+        assert(pc < segs[0].length);
+        uint32_t w = segs[0].words[pc++];
+        unsigned a = (w >> 6) & 7, b = (w >> 3) & 7, c = w & 7;
+        switch (w >> 28){
+            case CMOV:  if (r[c]) r[a] = r[b]; break;
+            case LOAD:  r[a] = segs[r[b]].words[r[c]]; break;
+            case STORE: segs[r[a]].words[r[b]] = r[c]; break;
+            case ADD:   r[a] = r[b] + r[c]; break;
+            case MULT:  r[a] = r[b] * r[c]; break;
+            case DIV:   r[a] = r[b] / r[c]; break;
+            case NAND:  r[a] = ~(r[b] & r[c]); break;
+            case HALT:
+                for (uint32_t i = 0; i < used; ++i){
+                    free(segs[i].words);
+                }
+                free(segs);
+                free(free_ids);
+                *length = outCount;
+                return out;
+            case MAP: {
+                uint32_t id;
+                if (freeCount > 0){
+                    id = free_ids[--freeCount];
+                }
+                else{
+                    if (used == capacity){
+                        capacity *= 2;
+                        segs = realloc(segs, capacity * sizeof(Seg));
+                        free_ids = realloc(free_ids, capacity * sizeof(uint32_t));
+                        assert(segs && free_ids);
+                    }
+                    id = used++;
+                }
+                segs[id].words = calloc((size_t)r[c] + 1, sizeof(uint32_t));
+                segs[id].length = r[c];
+                r[b] = id;
+                break;
+            }
+            case UNMAP:
+                free(segs[r[c]].words);
+                segs[r[c]].words = NULL;
+                free_ids[freeCount++] = r[c];
+                break;
+            case OUT:
+                if (outCount == outCapacity){
+                    outCapacity *= 2;
+                    out = realloc(out, outCapacity);
+                    assert(out);
+                }
+                out[outCount++] = (char)r[c];
+                break;
+            case IN:    r[c] = UINT32_MAX; break;
+            case LOADPROG:
+                if (r[b] != 0){
+                    Seg *from = &segs[r[b]];
+                    free(segs[0].words);
+                    segs[0].words = malloc(((size_t)from->length + 1) * sizeof(uint32_t));
+                    memcpy(segs[0].words, from->words, from->length * sizeof(uint32_t));
+                    segs[0].length = from->length;
+                }
+                pc = r[c];
+                break;
+            case LOADVAL: r[(w >> 25) & 7] = w & (LV_MAX - 1); break;
+            default:
+                fprintf(stderr, "Error, generated an invalid instruction.\n");
+                exit(1);
+        }
+    }
+}
+/**********************************************************/
+//Function generate assembles workload 'kind' into 'path' and
+//writes its expected output into 'path'.expected
+static void generate(const char *kind, const char *path, Params *p){
+    Asm a;
+    memset(&a, 0, sizeof(a));
+
+    if (strcmp(kind, "arith") == 0){
+        gen_arith(&a, p);
+    }
+    else if (strcmp(kind, "maps") == 0){
+        gen_maps(&a, p);
+    }
+    else if (strcmp(kind, "stream") == 0){
+        gen_stream(&a, p);
+    }
+    else if (strcmp(kind, "jumps") == 0){
+        gen_jumps(&a, p);
+    }
+    else{
+        fprintf(stderr, "Error, unknown workload %s.\n", kind);
+        exit(1);
+    }
+    finish(&a);
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening file %s.\n", path);
+        exit(1);
+    }
+    for (uint32_t i = 0; i < a.count; ++i){
+        unsigned char bytes[4] = { a.words[i] >> 24, a.words[i] >> 16,
+                                   a.words[i] >> 8, a.words[i] };
+        fwrite(bytes, 1, 4, fp);
+    }
+    fclose(fp);
+
+    size_t length;
+    char *expected = reference(a.words, a.count, &length);
+    size_t nameLength = strlen(path) + sizeof(".expected");
+    char *name = malloc(nameLength);
+    assert(name);
+    snprintf(name, nameLength, "%s.expected", path);
+    fp = fopen(name, "wb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening file %s.\n", name);
+        exit(1);
+    }
+    fwrite(expected, 1, length, fp);
+    fclose(fp);
+
+    free(name);
+    free(expected);
+    free(a.words);
+}
+/**********************************************************/
+//The images --suite writes: a name, the workload, and its
+//parameters
+static const char *suite[][3] = {
+    { "arith-add",     "arith",  "op=add" },
+    { "arith-mult",    "arith",  "op=mult" },
+    { "arith-div",     "arith",  "op=div" },
+    { "arith-nand",    "arith",  "op=nand" },
+    { "arith-cmov",    "arith",  "op=cmov" },
+    { "arith-loadval", "arith",  "op=loadval" },
+    { "arith-load",    "arith",  "op=load" },
+    { "arith-store",   "arith",  "op=store" },
+    { "maps-fixed",    "maps",   "sizes=fixed:16" },
+    { "maps-small",    "maps",   "sizes=uniform:1:64 window=256" },
+    { "maps-pow2",     "maps",   "sizes=pow2:65536 count=20000" },
+    { "stream",        "stream", "words=1048576 passes=8" },
+    { "jumps-small",   "jumps",  "size=1024 count=100000" },
+    { "jumps-large",   "jumps",  "size=262144 count=2000" },
+    { "jumps-write",   "jumps",  "size=65536 count=2000 write=1" }
+};
+/**********************************************************/
+//Function parse splits 'args' name=value words into 'p'
+static void parse(Params *p, int argc, char **argv){
+    p->count = argc;
+    p->names = malloc((argc + 1) * sizeof(char *));
+    p->values = malloc((argc + 1) * sizeof(char *));
+    assert(p->names && p->values);
+    for (int i = 0; i < argc; ++i){
+        char *equals = strchr(argv[i], '=');
+        if (equals == NULL){
+            fprintf(stderr, "Error, expected name=value, got %s.\n", argv[i]);
+            exit(1);
+        }
+        *equals = '\0';
+        p->names[i] = argv[i];
+        p->values[i] = equals + 1;
+    }
+}
+/**********************************************************/
+//This main function writes one image,
+//  umgen KIND IMAGE [name=value ...]
+//with KIND one of arith, maps, stream or jumps, or a whole
+//suite of them into a directory,
+//  umgen --suite DIR
+int main(int argc, char *argv[]){
+    Params p;
+
+    if (argc == 3 && strcmp(argv[1], "--suite") == 0){
+        for (size_t i = 0; i < sizeof(suite) / sizeof(suite[0]); ++i){
+            char path[4096];
+            char args[256];
+            char *words[8];
+            int n = 0;
+            snprintf(path, sizeof(path), "%s/%s.um", argv[2], suite[i][0]);
+            snprintf(args, sizeof(args), "%s", suite[i][2]);
+            for (char *w = strtok(args, " "); w != NULL && n < 8; w = strtok(NULL, " ")){
+                words[n++] = w;
+            }
+            parse(&p, n, words);
+            generate(suite[i][1], path, &p);
+            free(p.names);
+            free(p.values);
+            printf("%s\n", path);
+        }
+        return 0;
+    }
+
+    if (argc < 3){
+        fprintf(stderr,"Error, incorrect arguments.\n");
+        exit(1);
+    }
+    parse(&p, argc - 3, argv + 3);
+    generate(argv[1], argv[2], &p);
+    free(p.names);
+    free(p.values);
+    return 0;
+}
+/**********************************************************/
@@ -0,0 +1,207 @@
+//Timothy Colaneri
+//Universal Machine trace decoder
+
+/**********************************************************/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<inttypes.h>
+#include"um_exec.h"
+#include"um_ops.h"
+/**********************************************************/
+#define NAME(n, name, check) #name,
+static const char *const names[16] = { UM_OPCODES(NAME) };
+#undef NAME
+
+//A Summary holds the totals of --summary
+typedef struct Summary {
+    uint64_t instructions, jumps;
+    uint64_t opcodes[16];
+    uint64_t maps, unmaps, stores, loads;
+    uint64_t bytes;
+} Summary;
+/**********************************************************/
+//Function varint reads a varint from 'p', no further than
+//'end', and moves 'p' past it
+static uint64_t varint(const unsigned char **p, const unsigned char *end){
+    uint64_t value = 0;
+    for (unsigned shift = 0; *p < end && shift < 64; shift += 7){
+        unsigned char byte = *(*p)++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)){
+            return value;
+        }
+    }
+    fprintf(stderr, "Error, trace is corrupt.\n");
+    exit(1);
+}
+/**********************************************************/
+//Function decode decodes one block of 'fill' bytes. It prints
+//each instruction numbered 'from' on and its events to 'out',
+//unless 'out' is NULL, and adds everything to 'summary'.
+static void decode(const unsigned char *block, uint32_t fill, uint64_t from,
+                   FILE *out, Summary *summary){
+    const unsigned char *p = block, *end = block + fill;
+    if (p == end || *p++ != TRACE_KEY){
+        fprintf(stderr, "Error, trace block does not start with a key.\n");
+        exit(1);
+    }
+    uint32_t expect = varint(&p, end);
+    uint64_t count = varint(&p, end);
+    int shown = 0;  //whether the last instruction was printed
+
+    while (p < end){
+        unsigned char tag = *p++;
+        uint32_t pc;
+        switch (tag & 0xf0){
+            case TRACE_STEP:
+            case TRACE_JUMP:
+                pc = expect;
+                if ((tag & 0xf0) == TRACE_JUMP){
+                    uint32_t zigzag = varint(&p, end);
+                    pc += (zigzag >> 1) ^ -(zigzag & 1);
+                    ++summary->jumps;
+                }
+                ++summary->instructions;
+                ++summary->opcodes[tag & 0xf];
+                shown = out != NULL && count >= from;
+                if (shown){
+                    fprintf(out, "%" PRIu64 " %" PRIu32 " %s\n", count, pc, names[tag & 0xf]);
+                }
+                expect = pc + 1;
+                ++count;
+                break;
+            case TRACE_MAP: {
+                uint64_t id = varint(&p, end);
+                uint64_t words = varint(&p, end);
+                ++summary->maps;
+                if (shown){
+                    fprintf(out, "    map segment %" PRIu64 ", %" PRIu64 " words\n", id, words);
+                }
+                break;
+            }
+            case TRACE_UNMAP: {
+                uint64_t id = varint(&p, end);
+                ++summary->unmaps;
+                if (shown){
+                    fprintf(out, "    unmap segment %" PRIu64 "\n", id);
+                }
+                break;
+            }
+            case TRACE_STORE: {
+                uint64_t offset = varint(&p, end);
+                ++summary->stores;
+                if (shown){
+                    fprintf(out, "    store into segment 0 at %" PRIu64 "\n", offset);
+                }
+                break;
+            }
+            case TRACE_LOAD: {
+                uint64_t id = varint(&p, end);
+                ++summary->loads;
+                if (shown){
+                    fprintf(out, "    load program from segment %" PRIu64 "\n", id);
+                }
+                break;
+            }
+            default:
+                fprintf(stderr, "Error, trace has an unknown record %02x.\n", tag);
+                exit(1);
+        }
+    }
+    summary->bytes += fill;
+}
+/**********************************************************/
+//This main function decodes the trace file named by its
+//argument, written by um --trace. Options come before it:
+//  --summary                 report totals in place of the
+//                            instructions
+//  --last=N                  print only the last N instructions
+//It prints each instruction as its number, counting from 0
+//at the start of the run, its PC and its opcode, with its
+//events on the lines after, then how the machine stopped.
+int main(int argc, char *argv[]){
+    int summarize = 0;
+    uint64_t last = UINT64_MAX;
+    int argi = 1;
+
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; ++argi){
+        if (strcmp(argv[argi], "--summary") == 0){
+            summarize = 1;
+        }
+        else if (strncmp(argv[argi], "--last=", 7) == 0){
+            last = strtoull(argv[argi] + 7, NULL, 10);
+        }
+        else{
+            fprintf(stderr, "Error, unknown option %s.\n", argv[argi]);
+            exit(1);
+        }
+    }
+    if (argc - argi != 1){
+        fprintf(stderr, "usage: umtrace [--summary] [--last=N] TRACE\n");
+        exit(1);
+    }
+
+    FILE *fp = fopen(argv[argi], "rb");
+    if (fp == NULL){
+        fprintf(stderr, "Error opening file %s.\n", argv[argi]);
+        exit(1);
+    }
+    Trace_header header;
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0){
+        fprintf(stderr, "Error, %s is not a trace.\n", argv[argi]);
+        exit(1);
+    }
+    if (header.order != TRACE_ORDER){
+        fprintf(stderr, "Error, %s was written in another byte order.\n", argv[argi]);
+        exit(1);
+    }
+
+    //Decode the blocks in order, printing from instruction 'from'
+    uint64_t from = last < header.count ? header.count - last : 0;
+    unsigned char *block = malloc(header.blockSize);
+    Summary summary;
+    memset(&summary, 0, sizeof(summary));
+    for (uint32_t b = 0; b < header.blocks; ++b){
+        uint32_t fill;
+        if (block == NULL || fread(&fill, sizeof(fill), 1, fp) != 1
+            || fill > header.blockSize || fread(block, 1, fill, fp) != fill){
+            fprintf(stderr, "Error, trace is truncated.\n");
+            exit(1);
+        }
+        decode(block, fill, from, summarize ? NULL : stdout, &summary);
+    }
+    free(block);
+    fclose(fp);
+
+    if (summarize){
+        printf("instructions run:      %" PRIu64 "\n", header.count);
+        printf("instructions kept:     %" PRIu64 " in %" PRIu32 " blocks, %" PRIu64
+               " dropped\n", summary.instructions, header.blocks, header.dropped);
+        printf("bytes per instruction: %.2f\n",
+               summary.instructions ? (double)summary.bytes / summary.instructions : 0.0);
+        printf("jumps:                 %" PRIu64 "\n", summary.jumps);
+        printf("maps:                  %" PRIu64 "\n", summary.maps);
+        printf("unmaps:                %" PRIu64 "\n", summary.unmaps);
+        printf("stores to segment 0:   %" PRIu64 "\n", summary.stores);
+        printf("far load programs:     %" PRIu64 "\n", summary.loads);
+        for (int op = 0; op < 16; ++op){
+            if (summary.opcodes[op] != 0){
+                printf("  %-9s %12" PRIu64 "\n", names[op], summary.opcodes[op]);
+            }
+        }
+    }
+    if (header.status == INTERP_STOPPED){
+        printf("running at program counter %" PRIu32 "\n", header.pc);
+    }
+    else if (header.status == INTERP_HALTED){
+        printf("halted at program counter %" PRIu32 "\n", header.pc);
+    }
+    else{
+        printf("%s at program counter %" PRIu32 "\n",
+               Interp_fault((Interp_status)header.status), header.pc);
+    }
+    return 0;
+}
+/**********************************************************/